@@ -0,0 +1,309 @@
+#include "channel.h"
+#include "database.h"
+#include "logger.h"
+
+static const int readChannelBatch = 100;
+
+static bool succeeded(SQLRETURN ret) {
+    return ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO;
+}
+
+bool ChannelManager::createChannel(const std::string& ownerFirstName, const std::string& channelName) {
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Write, ownerFirstName)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    SQLLEN rowCount = 0;
+
+    SQLSetConnectAttr(hdbc, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_OFF, 0);
+
+    std::string queryCreateChannel = "INSERT INTO channels (name, owner_id) "
+        "SELECT ?, user_id FROM users WHERE first_name = ? AND deleted_at IS NULL LIMIT 1";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryCreateChannel.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)channelName.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)ownerFirstName.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+    SQLRowCount(hstmt, &rowCount);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    bool created = succeeded(ret) && rowCount > 0;
+    if (created) {
+        std::string queryAddOwner = "INSERT INTO channel_members (channel_id, user_id) "
+            "SELECT LAST_INSERT_ID(), user_id FROM users WHERE first_name = ? AND deleted_at IS NULL LIMIT 1";
+        ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+        ret = SQLPrepareA(hstmt, (SQLCHAR*)queryAddOwner.c_str(), SQL_NTS);
+        ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)ownerFirstName.c_str(), 0, NULL);
+        ret = SQLExecute(hstmt);
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        created = succeeded(ret);
+    }
+
+    SQLEndTran(SQL_HANDLE_DBC, hdbc, created ? SQL_COMMIT : SQL_ROLLBACK);
+    SQLSetConnectAttr(hdbc, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_ON, 0);
+
+    if (!created) {
+        std::cerr << "Failed to create channel." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to create channel.");
+        return false;
+    }
+
+    dbManager.recordWrite();
+    std::cout << "Channel '" << channelName << "' created." << std::endl;
+    logger.Log<LogLevel::Info>("Channel created.");
+    return true;
+}
+
+bool ChannelManager::joinChannel(const std::string& first_name, const std::string& channelName) {
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Write, first_name)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    SQLLEN rowCount = 0;
+
+    std::string queryJoin = "INSERT IGNORE INTO channel_members (channel_id, user_id) "
+        "SELECT c.channel_id, u.user_id FROM channels c, users u "
+        "WHERE c.name = ? AND u.first_name = ? AND u.deleted_at IS NULL LIMIT 1";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryJoin.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)channelName.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+    SQLRowCount(hstmt, &rowCount);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    if (!succeeded(ret) || rowCount == 0) {
+        std::cerr << "Failed to join channel." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to join channel.");
+        return false;
+    }
+
+    dbManager.recordWrite();
+    std::cout << "Joined channel '" << channelName << "'." << std::endl;
+    logger.Log<LogLevel::Info>("Joined channel.");
+    return true;
+}
+
+bool ChannelManager::leaveChannel(const std::string& first_name, const std::string& channelName) {
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Write, first_name)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    SQLLEN rowCount = 0;
+
+    std::string queryLeave = "DELETE m FROM channel_members m "
+        "INNER JOIN channels c ON c.channel_id = m.channel_id "
+        "INNER JOIN users u ON u.user_id = m.user_id "
+        "WHERE c.name = ? AND u.first_name = ? AND u.deleted_at IS NULL";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryLeave.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)channelName.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+    SQLRowCount(hstmt, &rowCount);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    if (!succeeded(ret) || rowCount == 0) {
+        std::cerr << "Failed to leave channel." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to leave channel.");
+        return false;
+    }
+
+    dbManager.recordWrite();
+    std::cout << "Left channel '" << channelName << "'." << std::endl;
+    logger.Log<LogLevel::Info>("Left channel.");
+    return true;
+}
+
+bool ChannelManager::postToChannel(const std::string& senderFirstName, const std::string& channelName, const std::string& messageText) {
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Write, senderFirstName)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    SQLLEN rowCount = 0;
+
+    // One row per post no matter how many members the channel has; the
+    // membership check is part of the same statement.
+    std::string queryPost = "INSERT INTO channel_messages (channel_id, sender_id, message_text, send_date) "
+        "SELECT m.channel_id, m.user_id, ?, CURRENT_TIMESTAMP FROM channel_members m "
+        "INNER JOIN channels c ON c.channel_id = m.channel_id "
+        "INNER JOIN users u ON u.user_id = m.user_id "
+        "WHERE c.name = ? AND u.first_name = ? AND u.deleted_at IS NULL LIMIT 1";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryPost.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 1000, 0, (SQLCHAR*)messageText.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)channelName.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 3, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)senderFirstName.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+    SQLRowCount(hstmt, &rowCount);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    if (!succeeded(ret) || rowCount == 0) {
+        std::cerr << "Failed to post to channel. Are you a member?" << std::endl;
+        logger.Log<LogLevel::Error>("Failed to post to channel.");
+        return false;
+    }
+
+    dbManager.recordWrite();
+    std::cout << "Posted to channel '" << channelName << "'." << std::endl;
+    logger.Log<LogLevel::Info>("Posted to channel.");
+    return true;
+}
+
+bool ChannelManager::readChannel(const std::string& first_name, const std::string& channelName) {
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Write, first_name)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+
+    std::string queryCursor = "SELECT m.channel_id, m.user_id, m.last_read_message_id FROM channel_members m "
+        "INNER JOIN channels c ON c.channel_id = m.channel_id "
+        "INNER JOIN users u ON u.user_id = m.user_id "
+        "WHERE c.name = ? AND u.first_name = ? AND u.deleted_at IS NULL LIMIT 1";
+    SQLINTEGER channelId = 0, userId = 0, lastRead = 0;
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryCursor.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)channelName.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+    SQLBindCol(hstmt, 1, SQL_C_SLONG, &channelId, sizeof(channelId), NULL);
+    SQLBindCol(hstmt, 2, SQL_C_SLONG, &userId, sizeof(userId), NULL);
+    SQLBindCol(hstmt, 3, SQL_C_SLONG, &lastRead, sizeof(lastRead), NULL);
+    ret = SQLFetch(hstmt);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    if (!succeeded(ret)) {
+        std::cerr << "You are not a member of channel '" << channelName << "'." << std::endl;
+        logger.Log<LogLevel::Warn>("Failed to read channel: not a member.");
+        return false;
+    }
+
+    std::string queryUnread = "SELECT cm.message_id, u.first_name, cm.message_text, cm.send_date "
+        "FROM channel_messages cm "
+        "INNER JOIN users u ON u.user_id = cm.sender_id "
+        "WHERE cm.channel_id = ? AND cm.message_id > ? "
+        "ORDER BY cm.message_id LIMIT " + std::to_string(readChannelBatch);
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryUnread.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &channelId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &lastRead, 0, NULL);
+    ret = SQLExecute(hstmt);
+
+    if (!succeeded(ret)) {
+        std::cerr << "Failed to read channel." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to read channel.");
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    std::cout << "New messages in '" << channelName << "':" << std::endl;
+    SQLINTEGER messageId, newLastRead = lastRead;
+    SQLCHAR senderName[50], message[1000], timestamp[50];
+    SQLLEN senderNameLen, messageLen, timestampLen;
+    int count = 0;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &messageId, sizeof(messageId), NULL);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, senderName, sizeof(senderName), &senderNameLen);
+        SQLGetData(hstmt, 3, SQL_C_CHAR, message, sizeof(message), &messageLen);
+        SQLGetData(hstmt, 4, SQL_C_CHAR, timestamp, sizeof(timestamp), &timestampLen);
+        std::cout << timestamp << " " << senderName << ": " << message << std::endl;
+        newLastRead = messageId;
+        ++count;
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    if (count == readChannelBatch) {
+        std::cout << "(more unread messages, read again to continue)" << std::endl;
+    }
+
+    if (newLastRead != lastRead) {
+        std::string queryAdvance = "UPDATE channel_members SET last_read_message_id = ? "
+            "WHERE channel_id = ? AND user_id = ? AND last_read_message_id < ?";
+        ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+        ret = SQLPrepareA(hstmt, (SQLCHAR*)queryAdvance.c_str(), SQL_NTS);
+        ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &newLastRead, 0, NULL);
+        ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &channelId, 0, NULL);
+        ret = SQLBindParameter(hstmt, 3, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &userId, 0, NULL);
+        ret = SQLBindParameter(hstmt, 4, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &newLastRead, 0, NULL);
+        ret = SQLExecute(hstmt);
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        if (succeeded(ret)) {
+            dbManager.recordWrite();
+        }
+    }
+
+    logger.Log<LogLevel::Info>("Channel read.");
+    return true;
+}
+
+void ChannelManager::listChannels(const std::string& first_name) {
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Read, first_name)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+
+    std::string queryChannels = "SELECT c.name, "
+        "(SELECT COUNT(*) FROM channel_messages cm WHERE cm.channel_id = m.channel_id AND cm.message_id > m.last_read_message_id) "
+        "FROM channel_members m "
+        "INNER JOIN channels c ON c.channel_id = m.channel_id "
+        "INNER JOIN users u ON u.user_id = m.user_id "
+        "WHERE u.first_name = ? AND u.deleted_at IS NULL ORDER BY c.name";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryChannels.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+
+    if (!succeeded(ret)) {
+        std::cerr << "Failed to list channels." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to list channels.");
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return;
+    }
+
+    std::cout << "Your channels:" << std::endl;
+    SQLCHAR channelName[50];
+    SQLINTEGER unread;
+    SQLLEN channelNameLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_CHAR, channelName, sizeof(channelName), &channelNameLen);
+        SQLGetData(hstmt, 2, SQL_C_SLONG, &unread, sizeof(unread), NULL);
+        std::cout << "  " << channelName << " (" << unread << " unread)" << std::endl;
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+}
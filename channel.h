@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+
+// Group channels with fan-out-on-read: a post is stored once in
+// channel_messages and each member keeps a read cursor
+// (last_read_message_id) in channel_members.
+class ChannelManager {
+public:
+    bool createChannel(const std::string& ownerFirstName, const std::string& channelName);
+    bool joinChannel(const std::string& first_name, const std::string& channelName);
+    bool leaveChannel(const std::string& first_name, const std::string& channelName);
+    bool postToChannel(const std::string& senderFirstName, const std::string& channelName, const std::string& messageText);
+    bool readChannel(const std::string& first_name, const std::string& channelName);
+    void listChannels(const std::string& first_name);
+};
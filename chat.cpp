@@ -6,7 +6,21 @@
 #include <sstream>
 #include "users.h"
 #include "message.h"
+#include "channel.h"
+#include "notify.h"
 #include "logger.h"
+#include "config.h"
+#include "shards.h"
+#include "retention.h"
+#include "historycache.h"
+#include "inbox.h"
+#include "trace.h"
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
 
 SQLRETURN ret;
 SQLHANDLE henv;
@@ -15,54 +29,371 @@ SQLHANDLE hstmt;
 MessageManager messageManager;
 
 Logger logger("log.txt");
+Config config("chatdb.cfg");
 
-void ChatManager::displayUserChat(const std::string& username) {
-    DatabaseManager dbManager;
-    if (dbManager.connectToDatabase()) {
-        SQLRETURN ret;
-        SQLHANDLE hstmt;
-        SQLHANDLE hdbc = dbManager.getHDBC();
-        std::string queryGetChat = "SELECT u.first_name, m.message_text, m.send_date "
-            "FROM messages m "
-            "INNER JOIN users u ON m.sender_id = u.user_id "
-            "WHERE u.first_name = ? "
-            "ORDER BY m.send_date";
+struct ChatLine {
+    int messageId;
+    std::string timestamp;
+    std::string message;
+};
+
+static bool fetchSentMessages(SQLHANDLE hdbc, const std::vector<SQLINTEGER>& userIds, std::vector<ChatLine>& lines) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryGetChat = "SELECT m.message_id, m.message_text, m.send_date "
+        "FROM messages m "
+        "WHERE m.sender_id IN (?";
+    for (size_t i = 1; i < userIds.size(); ++i) {
+        queryGetChat += ", ?";
+    }
+    queryGetChat += ") ORDER BY m.send_date";
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryGetChat.c_str(), SQL_NTS); });
+    for (size_t i = 0; i < userIds.size(); ++i) {
+        ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(i + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, (SQLPOINTER)&userIds[i], 0, NULL);
+    }
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    SQLINTEGER messageId;
+    SQLCHAR message[1000], timestamp[50];
+    SQLLEN messageIdLen, messageLen, timestampLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &messageId, sizeof(messageId), &messageIdLen);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, message, sizeof(message), &messageLen);
+        SQLGetData(hstmt, 3, SQL_C_CHAR, timestamp, sizeof(timestamp), &timestampLen);
+        lines.push_back({ messageId, (char*)timestamp, (char*)message });
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+// Renders the first screen straight from the cache, without touching
+// the database, and remembers which messages it showed. Messages too
+// long for a cache record are left to the full read.
+static void displayCachedChat(const std::string& username, HistoryCache& cache, std::set<std::pair<int, std::string>>& shown) {
+    std::vector<CachedMessage> messages;
+    cache.read(0, messages);
+
+    std::cout << "Chat history for user '" << username << "':" << std::endl;
+    logger.Log<LogLevel::Info>("Chat history for user");
+    for (const CachedMessage& message : messages) {
+        if (message.complete) {
+            std::cout << message.timestamp << " " << username << ": " << message.text << std::endl;
+            shown.insert(std::make_pair(message.messageId, message.timestamp));
+        }
+    }
+}
 
-        ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
-        ret = SQLPrepareA(hstmt, (SQLCHAR*)queryGetChat.c_str(), SQL_NTS);
-        ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)username.c_str(), 0, NULL);
+bool ChatManager::displayUserChat(const std::string& username) {
+    TraceSpan span("chat.displayUserChat");
+    // A warm cache paints the recent messages at once and is refreshed
+    // in the background for the next read; the full history below then
+    // adds only what the first screen did not show.
+    std::set<std::pair<int, std::string>> shown;
+    std::shared_ptr<HistoryCache> cache = HistoryCache::open(username);
+    if (cache && cache->isWarm()) {
+        displayCachedChat(username, *cache, shown);
+        cache->startSync(username);
+    }
 
-        ret = SQLExecute(hstmt);
+    DatabaseManager dbManager;
+    if (dbManager.connectToDatabase(AccessMode::Read, username)) {
+        std::vector<SQLINTEGER> userIds;
+        MessageShards& shards = MessageShards::instance();
+        std::vector<std::vector<ChatLine>> shardLines(shards.count());
 
-        if (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) {
-            std::cout << "Chat history for user '" << username << "':" << std::endl;
-            logger.WriteLog("Chat history for user");
+        bool ok = UserManager::findUserIds(dbManager.getHDBC(), username, userIds);
+        if (ok && !userIds.empty()) {
+            ok = shards.forEachShard([&](size_t shard, SQLHANDLE hdbc) {
+                return fetchSentMessages(hdbc, userIds, shardLines[shard]);
+            }, AccessMode::Read, username, &dbManager);
+        }
 
-            SQLCHAR senderName[50], message[1000], timestamp[50];
-            SQLLEN senderNameLen, messageLen, timestampLen;
+        // Partitions past retention_days live only in the archive files;
+        // they are all older than anything still in the live table.
+        std::vector<ChatLine> lines;
+        std::vector<ArchivedMessage> archived;
+        if (ok && !userIds.empty() && RetentionManager::instance().readArchived(userIds, archived)) {
+            for (const ArchivedMessage& message : archived) {
+                lines.push_back({ message.messageId, message.sendDate, message.messageText });
+            }
+            std::sort(lines.begin(), lines.end(),
+                [](const ChatLine& a, const ChatLine& b) { return a.timestamp < b.timestamp; });
+        }
 
-            while (SQLFetch(hstmt) == SQL_SUCCESS) {
-                SQLGetData(hstmt, 1, SQL_C_CHAR, senderName, sizeof(senderName), &senderNameLen);
-                SQLGetData(hstmt, 2, SQL_C_CHAR, message, sizeof(message), &messageLen);
-                SQLGetData(hstmt, 3, SQL_C_CHAR, timestamp, sizeof(timestamp), &timestampLen);
+        if (ok) {
+            for (const std::vector<ChatLine>& shard : shardLines) {
+                size_t middle = lines.size();
+                lines.insert(lines.end(), shard.begin(), shard.end());
+                std::inplace_merge(lines.begin(), lines.begin() + middle, lines.end(),
+                    [](const ChatLine& a, const ChatLine& b) { return a.timestamp < b.timestamp; });
+            }
 
-                std::cout << timestamp << " " << senderName << ": " << message << std::endl;
+            if (shown.empty()) {
+                std::cout << "Chat history for user '" << username << "':" << std::endl;
+                logger.Log<LogLevel::Info>("Chat history for user");
             }
 
+            std::string lastShown = shown.empty() ? "" : std::max_element(shown.begin(), shown.end(),
+                [](const std::pair<int, std::string>& a, const std::pair<int, std::string>& b) { return a.second < b.second; })->second;
+            const char* heading = nullptr;
+            for (const ChatLine& line : lines) {
+                if (shown.count(std::make_pair(line.messageId, line.timestamp))) {
+                    continue;
+                }
+                const char* section = shown.empty() ? nullptr : line.timestamp <= lastShown ? "Earlier messages:" : "Newer messages:";
+                if (section != heading) {
+                    std::cout << section << std::endl;
+                    heading = section;
+                }
+                std::cout << line.timestamp << " " << username << ": " << line.message << std::endl;
+            }
         }
         else {
             std::cerr << "Failed to retrieve chat history." << std::endl;
-            logger.WriteLog("Failed to retrieve chat history.");
+            logger.Log<LogLevel::Error>("Failed to retrieve chat history.");
             dbManager.disconnectFromDatabase();
-            return;
+            return false;
         }
 
-        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
         dbManager.disconnectFromDatabase();
+        return true;
     }
     else {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+}
+
+static bool fetchMessage(SQLHANDLE hdbc, SQLINTEGER messageId, std::string& message, std::string& timestamp) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryGetMessage = "SELECT message_text, send_date FROM messages WHERE message_id = ?";
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryGetMessage.c_str(), SQL_NTS); });
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &messageId, 0, NULL);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+
+    SQLCHAR messageText[1000], sendDate[50];
+    SQLLEN messageLen, sendDateLen;
+    bool found = (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) && SQLFetch(hstmt) == SQL_SUCCESS;
+    if (found) {
+        SQLGetData(hstmt, 1, SQL_C_CHAR, messageText, sizeof(messageText), &messageLen);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, sendDate, sizeof(sendDate), &sendDateLen);
+        message = (char*)messageText;
+        timestamp = (char*)sendDate;
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return found;
+}
+
+static std::string fetchFirstName(SQLHANDLE hdbc, SQLINTEGER userId) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryGetName = "SELECT first_name FROM users WHERE user_id = ?";
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryGetName.c_str(), SQL_NTS); });
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &userId, 0, NULL);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+
+    SQLCHAR firstName[50] = "";
+    SQLLEN firstNameLen;
+    if ((ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) && SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_CHAR, firstName, sizeof(firstName), &firstNameLen);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return (char*)firstName;
+}
+
+// The setup is traced as one action and each batch of delivered messages
+// as another, so no trace includes the time spent waiting.
+void ChatManager::watchUserChat(const std::string& username) {
+    std::unique_ptr<TraceAction> setup(new TraceAction("chatRoom.watch"));
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Read, username)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return;
+    }
+
+    std::vector<SQLINTEGER> userIds;
+    if (!UserManager::findUserIds(dbManager.getHDBC(), username, userIds) || userIds.empty()) {
+        std::cerr << "Failed to find user '" << username << "'." << std::endl;
+        logger.Log<LogLevel::Warn>("Failed to find user to watch.");
+        dbManager.disconnectFromDatabase();
+        return;
+    }
+
+    NotificationHub& hub = NotificationHub::instance();
+    std::shared_ptr<NotificationHub::Subscription> subscription = hub.subscribe(std::vector<int>(userIds.begin(), userIds.end()));
+    std::cout << "Watching for new messages. Press Enter to stop." << std::endl;
+    logger.Log<LogLevel::Info>("Watching for new messages.");
+
+    // Only the rows announced by the hub are fetched, each from the one
+    // shard that holds its conversation; shard connections stay open
+    // for the whole watch.
+    std::thread watcher([&]() {
+        MessageShards& shards = MessageShards::instance();
+        std::vector<std::unique_ptr<DatabaseManager>> shardManagers(shards.count());
+        std::map<int, std::string> senderNames;
+        std::vector<MessageNotification> notifications;
+
+        while (subscription->wait(notifications, std::chrono::milliseconds(1000))) {
+            if (notifications.empty()) {
+                continue;
+            }
+            TraceAction delivery("chat.watchDelivery");
+            for (const MessageNotification& notification : notifications) {
+                size_t shard = notification.shard;
+                if (!shardManagers[shard]) {
+                    shardManagers[shard].reset(new DatabaseManager());
+                    if (!shards.connect(*shardManagers[shard], shard)) {
+                        shardManagers[shard].reset();
+                        continue;
+                    }
+                }
+                if (!senderNames.count(notification.senderId)) {
+                    senderNames[notification.senderId] = fetchFirstName(dbManager.getHDBC(), notification.senderId);
+                }
+
+                std::string message, timestamp;
+                if (fetchMessage(shardManagers[shard]->getHDBC(), notification.messageId, message, timestamp)) {
+                    std::cout << timestamp << " " << senderNames[notification.senderId] << ": " << message << std::endl;
+                }
+            }
+        }
+
+        for (std::unique_ptr<DatabaseManager>& shardManager : shardManagers) {
+            if (shardManager) {
+                shardManager->disconnectFromDatabase();
+            }
+        }
+    });
+    setup.reset();
+
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    std::cin.get();
+    subscription->cancel();
+    watcher.join();
+    hub.unsubscribe(subscription);
+
+    logger.Log<LogLevel::Info>("Stopped watching for new messages.");
+    dbManager.disconnectFromDatabase();
+}
+
+void channelRoom(const std::string& first_name) {
+    ChannelManager channelManager;
+    int choice;
+
+    do {
+        std::cout << "Channel Options:" << std::endl;
+        std::cout << "1. List My Channels" << std::endl;
+        std::cout << "2. Create Channel" << std::endl;
+        std::cout << "3. Join Channel" << std::endl;
+        std::cout << "4. Leave Channel" << std::endl;
+        std::cout << "5. Post to Channel" << std::endl;
+        std::cout << "6. Read Channel" << std::endl;
+        std::cout << "7. Back" << std::endl;
+        std::cout << "Enter your choice: ";
+        std::cin >> choice;
+
+        // Each action is traced once its input is in, so the trace times
+        // the work and not the typing.
+        std::string channelName;
+        switch (choice) {
+        case 1: {
+            TraceAction action("channelRoom.list");
+            channelManager.listChannels(first_name);
+            break;
+        }
+        case 2: {
+            std::cout << "Enter the channel name: ";
+            std::cin >> channelName;
+            TraceAction action("channelRoom.create");
+            channelManager.createChannel(first_name, channelName);
+            break;
+        }
+        case 3: {
+            std::cout << "Enter the channel name: ";
+            std::cin >> channelName;
+            TraceAction action("channelRoom.join");
+            channelManager.joinChannel(first_name, channelName);
+            break;
+        }
+        case 4: {
+            std::cout << "Enter the channel name: ";
+            std::cin >> channelName;
+            TraceAction action("channelRoom.leave");
+            channelManager.leaveChannel(first_name, channelName);
+            break;
+        }
+        case 5: {
+            std::string messageText;
+            std::cout << "Enter the channel name: ";
+            std::cin >> channelName;
+            std::cout << "Enter the message: ";
+            std::cin.ignore();
+            std::getline(std::cin, messageText);
+            TraceAction action("channelRoom.post");
+            channelManager.postToChannel(first_name, channelName, messageText);
+            break;
+        }
+        case 6: {
+            std::cout << "Enter the channel name: ";
+            std::cin >> channelName;
+            TraceAction action("channelRoom.read");
+            channelManager.readChannel(first_name, channelName);
+            break;
+        }
+        case 7:
+            return;
+        default:
+            std::cout << "Invalid choice. Please select a valid option." << std::endl;
+            logger.Log<LogLevel::Warn>("Invalid choice. Please select a valid option.");
+            break;
+        }
+    } while (true);
+}
+
+// Lists the inbox and optionally opens one conversation, which resets
+// its unread count.
+static void conversationsRoom(const std::string& first_name) {
+    InboxManager inboxManager;
+    std::vector<Conversation> conversations;
+    bool listed;
+    {
+        TraceAction action("chatRoom.conversations");
+        listed = inboxManager.listConversations(first_name, conversations);
+    }
+    if (!listed) {
+        return;
+    }
+    if (conversations.empty()) {
+        std::cout << "No conversations yet." << std::endl;
+        return;
+    }
+
+    std::cout << "Conversations:" << std::endl;
+    for (size_t i = 0; i < conversations.size(); ++i) {
+        const Conversation& conversation = conversations[i];
+        std::cout << i + 1 << ". " << conversation.peerName << " (" << conversation.unreadCount << " unread) "
+            << conversation.lastDate << ": " << conversation.preview << std::endl;
+    }
+
+    size_t choice;
+    std::cout << "Open conversation (0 to go back): ";
+    std::cin >> choice;
+    if (choice >= 1 && choice <= conversations.size()) {
+        TraceAction action("chatRoom.openConversation");
+        inboxManager.openConversation(first_name, conversations[choice - 1]);
     }
 }
 
@@ -70,6 +401,11 @@ void chatRoom(const std::string& first_name) {
     std::system("cls");
     int choice;
 
+    // Bring the local history cache up to date while the menu is shown.
+    if (std::shared_ptr<HistoryCache> cache = HistoryCache::open(first_name)) {
+        cache->startSync(first_name);
+    }
+
     do {
         
         std::cout << "Chat Room Options:" << std::endl;
@@ -77,10 +413,14 @@ void chatRoom(const std::string& first_name) {
         std::cout << "2. Read Messages" << std::endl;
         std::cout << "3. Read Log" << std::endl;
         std::cout << "4. Delete User" << std::endl;
-        std::cout << "5. Exit Chat Room" << std::endl;
+        std::cout << "5. Channels" << std::endl;
+        std::cout << "6. Watch for New Messages" << std::endl;
+        std::cout << "7. Conversations" << std::endl;
+        std::cout << "8. Exit Chat Room" << std::endl;
         std::cout << "Enter your choice: ";
         std::cin >> choice;
 
+        // As in channelRoom, actions are traced after their input.
         switch (choice) {
         case 1: {
             std::string receiverFirstName, messageText;
@@ -90,23 +430,29 @@ void chatRoom(const std::string& first_name) {
             std::cin.ignore();
             std::getline(std::cin, messageText);
 
-
-            if (messageManager.sendMessage(first_name, receiverFirstName, messageText)) {
+            bool sent;
+            {
+                TraceAction action("chatRoom.send");
+                sent = messageManager.sendMessage(first_name, receiverFirstName, messageText);
+            }
+            if (sent) {
                 std::cout << "Message sent." << std::endl;
-                logger.WriteLog("Message sent.");
+                logger.Log<LogLevel::Info>("Message sent.");
             }
             else {
                 std::cout << "Failed to send message." << std::endl;
-                logger.WriteLog("Failed to send message.");
+                logger.Log<LogLevel::Error>("Failed to send message.");
             }
             break;
         }
         case 2: {
+            TraceAction action("chatRoom.read");
             ChatManager chatManager;
             chatManager.displayUserChat(first_name);
             break;
         }
         case 3: {
+            TraceAction action("chatRoom.readLog");
             std::string lastLogLines = logger.ReadLastLines(10);
             std::cout << "Last 10 log lines:\n" << lastLogLines << std::endl;
 
@@ -122,24 +468,43 @@ void chatRoom(const std::string& first_name) {
             std::cout << "Enter the first name of the user to delete: ";
             std::cin >> first_name_to_delete;
             UserManager userManager;
-            if (userManager.deleteUserAndMessages(first_name_to_delete)) {
+            bool deleted;
+            {
+                TraceAction action("chatRoom.deleteUser");
+                deleted = userManager.deleteUserAndMessages(first_name_to_delete);
+            }
+            if (deleted) {
                 std::cout << "User and related messages deleted successfully." << std::endl;
-                logger.WriteLog("User and related messages deleted successfully.");
+                logger.Log<LogLevel::Info>("User and related messages deleted successfully.");
             }
             else {
                 std::cout << "Failed to delete user and related messages." << std::endl;
-                logger.WriteLog("Failed to delete user and related messages.");
+                logger.Log<LogLevel::Error>("Failed to delete user and related messages.");
             }
             break;
         }
         case 5: {
+            channelRoom(first_name);
+            break;
+        }
+        case 6: {
+            ChatManager chatManager;
+            chatManager.watchUserChat(first_name);
+            break;
+        }
+        case 7: {
+            conversationsRoom(first_name);
+            break;
+        }
+        case 8: {
             std::cout << "Exiting Chat Room." << std::endl;
-            logger.WriteLog("Exiting Chat Room.");
+            logger.Log<LogLevel::Info>("Exiting Chat Room.");
+            HistoryCache::close(first_name);
             return;
         }
         default: {
             std::cout << "Invalid choice. Please select a valid option." << std::endl;
-            logger.WriteLog("Invalid choice. Please select a valid option.");
+            logger.Log<LogLevel::Warn>("Invalid choice. Please select a valid option.");
             break;
         }
         }
@@ -165,14 +530,19 @@ void chatMenu() {
             std::cout << "Enter your last name: "; std::cin >> last_name;
             std::cout << "Enter your email: "; std::cin >> email;
 
-            if (userManager.registerUser(first_name, last_name, email)) {
+            bool registered;
+            {
+                TraceAction action("chatMenu.register");
+                registered = userManager.registerUser(first_name, last_name, email);
+            }
+            if (registered) {
                 std::cout << "Registration successful. Welcome, " << first_name << "!" << std::endl;
-                logger.WriteLog("Registration successful. Welcome");
+                logger.Log<LogLevel::Info>("Registration successful. Welcome");
                 chatRoom(first_name);
             }
             else {
                 std::cout << "Registration failed. Please try again." << std::endl;
-                logger.WriteLog("Registration failed. Please try again.");
+                logger.Log<LogLevel::Warn>("Registration failed. Please try again.");
             }
             break;
         }
@@ -180,27 +550,32 @@ void chatMenu() {
             std::cout << "Enter your first name: "; std::cin >> first_name;
             std::cout << "Enter your password hash: "; std::cin >> password_hash;
 
-            if (userManager.loginPass(first_name, password_hash)) {
+            bool loggedIn;
+            {
+                TraceAction action("chatMenu.login");
+                loggedIn = userManager.loginPass(first_name, password_hash);
+            }
+            if (loggedIn) {
                 std::cout << "Login successful. Welcome, " << first_name << "!" << std::endl;
-                logger.WriteLog("Login successful. Welcome");
+                logger.Log<LogLevel::Info>("Login successful. Welcome");
                 chatRoom(first_name);
             }
             else {
                 std::cout << "Login failed. Please check your credentials." << std::endl;
-                logger.WriteLog("Login failed. Please check your credentials.");
+                logger.Log<LogLevel::Warn>("Login failed. Please check your credentials.");
             }
             break;
         }
         case 3: {
             std::cout << "Exiting the chat." << std::endl;
-            logger.WriteLog("Exiting the chat.");
+            logger.Log<LogLevel::Info>("Exiting the chat.");
             dbManager.disconnectFromDatabase();
 
             return;
         }
         default: {
             std::cout << "Invalid choice. Please select a valid option." << std::endl;
-            logger.WriteLog("Invalid choice. Please select a valid option.");
+            logger.Log<LogLevel::Warn>("Invalid choice. Please select a valid option.");
             break;
         }
         }
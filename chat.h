@@ -3,5 +3,6 @@
 
 class ChatManager {
 public:
-    void displayUserChat(const std::string& username);
+    bool displayUserChat(const std::string& username);
+    void watchUserChat(const std::string& username);
 };
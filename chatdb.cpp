@@ -1,9 +1,46 @@
 ﻿#include "database.h"
+#include "snapshot.h"
+#include "retention.h"
+#include "purger.h"
+#include "trace.h"
+#include "config.h"
+#include "logger.h"
+#include <string>
 
 void chatMenu();
 
-int main() {
+int main(int argc, char* argv[]) {
 
+    LogLevel logLevel;
+    if (parseLogLevel(config.get("log_level", "info"), logLevel)) {
+        logger.SetLevel(logLevel);
+    }
+
+    std::string traceFile = config.get("trace_file", "");
+    if (!traceFile.empty()) {
+        Tracer::instance().enable(traceFile, static_cast<size_t>(config.getInt("trace_max_events", 100000)));
+    }
+
+    if (argc == 3) {
+        std::string command = argv[1];
+        SnapshotManager snapshotManager;
+        if (command == "--export") {
+            return snapshotManager.exportSnapshot(argv[2]) ? 0 : 1;
+        }
+        if (command == "--import") {
+            return snapshotManager.importSnapshot(argv[2]) ? 0 : 1;
+        }
+        std::cerr << "Usage: chatdb [--export <file> | --import <file>]" << std::endl;
+        return 1;
+    }
+
+    RetentionManager::instance().start();
+    UserPurger::instance().start();
     chatMenu();
+    UserPurger::instance().stop();
+    RetentionManager::instance().stop();
+    if (Tracer::instance().isEnabled() && !Tracer::instance().flush()) {
+        std::cerr << "Failed to write trace file '" << traceFile << "'." << std::endl;
+    }
     return 0;
 }
@@ -0,0 +1,85 @@
+#include "circuitbreaker.h"
+#include "logger.h"
+#include <map>
+#include <memory>
+
+CircuitBreaker::CircuitBreaker(int failureThreshold, std::chrono::milliseconds openTimeout)
+    : state(State::Closed), failureThreshold(failureThreshold), consecutiveFailures(0), probeInFlight(false), openTimeout(openTimeout) {}
+
+bool CircuitBreaker::allowRequest() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    switch (state) {
+    case State::Closed:
+        return true;
+    case State::Open:
+        if (std::chrono::steady_clock::now() - openedAt < openTimeout) {
+            return false;
+        }
+        state = State::HalfOpen;
+        probeInFlight = true;
+        logger.Log<LogLevel::Info>("Circuit breaker half-open, probing the database.");
+        return true;
+    case State::HalfOpen:
+        if (probeInFlight) {
+            return false;
+        }
+        probeInFlight = true;
+        return true;
+    }
+    return false;
+}
+
+bool CircuitBreaker::isAvailable() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    switch (state) {
+    case State::Closed:
+        return true;
+    case State::Open:
+        return std::chrono::steady_clock::now() - openedAt >= openTimeout;
+    case State::HalfOpen:
+        return !probeInFlight;
+    }
+    return false;
+}
+
+void CircuitBreaker::recordSuccess() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    if (state != State::Closed) {
+        logger.Log<LogLevel::Info>("Circuit breaker closed.");
+    }
+    state = State::Closed;
+    consecutiveFailures = 0;
+    probeInFlight = false;
+}
+
+void CircuitBreaker::recordFailure() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+
+    probeInFlight = false;
+    ++consecutiveFailures;
+    if (state == State::HalfOpen || (state == State::Closed && consecutiveFailures >= failureThreshold)) {
+        state = State::Open;
+        openedAt = std::chrono::steady_clock::now();
+        logger.Log<LogLevel::Warn>("Circuit breaker opened.", logField("failures", consecutiveFailures));
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::getState() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return state;
+}
+
+CircuitBreaker& circuitBreakerFor(const std::wstring& dataSource) {
+    static std::mutex breakersMutex;
+    static std::map<std::wstring, std::unique_ptr<CircuitBreaker>> breakers;
+
+    std::lock_guard<std::mutex> lock(breakersMutex);
+    std::unique_ptr<CircuitBreaker>& breaker = breakers[dataSource];
+    if (!breaker) {
+        breaker.reset(new CircuitBreaker());
+    }
+    return *breaker;
+}
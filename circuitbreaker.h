@@ -0,0 +1,33 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// Fails fast while a data source keeps refusing connections. After
+// failureThreshold consecutive failures the breaker opens; once
+// openTimeout has passed a single probe request is let through
+// (half-open) and its result either closes or re-opens the breaker.
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+    CircuitBreaker(int failureThreshold = 3, std::chrono::milliseconds openTimeout = std::chrono::milliseconds(5000));
+
+    bool allowRequest();
+    // Like allowRequest() but without claiming the half-open probe.
+    bool isAvailable();
+    void recordSuccess();
+    void recordFailure();
+    State getState();
+
+private:
+    std::mutex stateMutex;
+    State state;
+    int failureThreshold;
+    int consecutiveFailures;
+    bool probeInFlight;
+    std::chrono::milliseconds openTimeout;
+    std::chrono::steady_clock::time_point openedAt;
+};
+
+CircuitBreaker& circuitBreakerFor(const std::wstring& dataSource);
@@ -0,0 +1,69 @@
+#include "config.h"
+#include <fstream>
+#include <stdexcept>
+
+static std::string trim(const std::string& value) {
+    size_t begin = value.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = value.find_last_not_of(" \t\r");
+    return value.substr(begin, end - begin + 1);
+}
+
+Config::Config(const std::string& configFilePath) {
+    load(configFilePath);
+}
+
+bool Config::load(const std::string& configFilePath) {
+    std::ifstream configFile(configFilePath);
+    std::string line;
+
+    std::lock_guard<std::mutex> lock(configMutex);
+    entries.clear();
+    while (std::getline(configFile, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            continue;
+        }
+        entries.emplace_back(trim(line.substr(0, separator)), trim(line.substr(separator + 1)));
+    }
+    return configFile.is_open();
+}
+
+std::string Config::get(const std::string& key, const std::string& defaultValue) {
+    std::lock_guard<std::mutex> lock(configMutex);
+
+    for (const auto& entry : entries) {
+        if (entry.first == key) {
+            return entry.second;
+        }
+    }
+    return defaultValue;
+}
+
+int Config::getInt(const std::string& key, int defaultValue) {
+    std::string value = get(key);
+    try {
+        return value.empty() ? defaultValue : std::stoi(value);
+    }
+    catch (const std::exception&) {
+        return defaultValue;
+    }
+}
+
+std::vector<std::string> Config::getAll(const std::string& key) {
+    std::lock_guard<std::mutex> lock(configMutex);
+
+    std::vector<std::string> values;
+    for (const auto& entry : entries) {
+        if (entry.first == key) {
+            values.push_back(entry.second);
+        }
+    }
+    return values;
+}
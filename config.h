@@ -0,0 +1,24 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Settings from chatdb.cfg, one "key=value" per line, '#' starts a
+// comment. A key may repeat (e.g. several replica lines).
+class Config {
+public:
+    Config(const std::string& configFilePath);
+
+    // Replaces the current settings with the contents of another file.
+    bool load(const std::string& configFilePath);
+
+    std::string get(const std::string& key, const std::string& defaultValue = "");
+    int getInt(const std::string& key, int defaultValue);
+    std::vector<std::string> getAll(const std::string& key);
+
+private:
+    std::mutex configMutex;
+    std::vector<std::pair<std::string, std::string>> entries;
+};
+
+extern Config config;
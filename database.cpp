@@ -1,74 +1,331 @@
 #include "database.h"
 #include "logger.h"
+#include "circuitbreaker.h"
+#include "config.h"
+#include "inbox.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <random>
 #include <thread>
 
 std::mutex logMutex;
-DatabaseManager::DatabaseManager() : henv(nullptr), hdbc(nullptr), hstmt(nullptr), ret(SQL_SUCCESS) {
-    checkAndCreateDatabase();
+
+static const char* queryCreateRegisterUserTrigger = "CREATE TRIGGER register_user_trigger\n"
+    "AFTER INSERT ON users\n"
+    "FOR EACH ROW\n"
+    "BEGIN\n"
+    "    INSERT INTO passwords (user_id, password_hash) VALUES (NEW.user_id, 'pass');\n"
+    "END;";
+
+static const char* queryCreateDeleteTrigger = "CREATE TRIGGER delete_user_trigger\n"
+    "BEFORE DELETE ON users\n"
+    "FOR EACH ROW\n"
+    "BEGIN\n"
+    "    DELETE FROM passwords WHERE user_id = OLD.user_id;\n"
+    "END;";
+
+// Tables added after the original schema. Every statement is idempotent
+// and runs once per process, so existing databases pick them up too.
+static const char* schemaUpgrades[] = {
+    "CREATE TABLE IF NOT EXISTS channels ("
+    "channel_id INTEGER PRIMARY KEY AUTO_INCREMENT,"
+    "name VARCHAR(50) UNIQUE NOT NULL,"
+    "owner_id INTEGER NOT NULL,"
+    "created_date TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP"
+    ");",
+    "CREATE TABLE IF NOT EXISTS channel_members ("
+    "channel_id INTEGER NOT NULL,"
+    "user_id INTEGER NOT NULL,"
+    "last_read_message_id INTEGER NOT NULL DEFAULT 0,"
+    "PRIMARY KEY (channel_id, user_id),"
+    "INDEX (user_id),"
+    "FOREIGN KEY (channel_id) REFERENCES channels(channel_id)"
+    ");",
+    "CREATE TABLE IF NOT EXISTS channel_messages ("
+    "message_id INTEGER PRIMARY KEY AUTO_INCREMENT,"
+    "channel_id INTEGER NOT NULL,"
+    "sender_id INTEGER NOT NULL,"
+    "message_text TEXT NOT NULL,"
+    "send_date TIMESTAMP NOT NULL,"
+    "INDEX (channel_id, message_id),"
+    "INDEX (sender_id),"
+    "FOREIGN KEY (channel_id) REFERENCES channels(channel_id)"
+    ");",
+    "CREATE TABLE IF NOT EXISTS inbox ("
+    "user_id INTEGER NOT NULL,"
+    "peer_id INTEGER NOT NULL,"
+    "last_message_id INTEGER NOT NULL,"
+    "preview VARCHAR(100) NOT NULL,"
+    "last_date TIMESTAMP NOT NULL,"
+    "unread_count INTEGER NOT NULL DEFAULT 0,"
+    "PRIMARY KEY (user_id, peer_id),"
+    "INDEX (user_id, last_date),"
+    "INDEX (peer_id)"
+    ");",
+};
+
+// Columns added to existing tables. MySQL has no ADD COLUMN IF NOT
+// EXISTS, so each one is looked up in INFORMATION_SCHEMA first.
+struct ColumnUpgrade {
+    const char* table;
+    const char* column;
+    const char* alter;
+};
+
+static const ColumnUpgrade columnUpgrades[] = {
+    { "users", "deleted_at", "ALTER TABLE users ADD COLUMN deleted_at TIMESTAMP NULL DEFAULT NULL, ADD INDEX (deleted_at)" },
+};
+
+static const char* defaultServerConnectionString = "DRIVER={MySQL ODBC 8.0 ANSI Driver};"
+    "SERVER=localhost;"
+    "USER=root;"
+    "PASSWORD=root;"
+    "OPTION=3;";
+
+// Bootstrap has to reach the primary's server before the database
+// exists, so it uses the configured primary connection string with its
+// DATABASE/DB attribute removed, and creates the database named there
+// (chatdb if none). A DSN that selects the database itself cannot be
+// used for that; set "server=" in chatdb.cfg instead. Without either
+// entry the original local default is kept.
+static std::string serverConnectionString(std::string& databaseName) {
+    std::string primary = config.get("primary", "");
+    std::string server = config.get("server", "");
+    databaseName = "chatdb";
+
+    std::string derived;
+    size_t start = 0;
+    while (start < primary.size()) {
+        size_t end = start;
+        int braces = 0;
+        while (end < primary.size() && (primary[end] != ';' || braces > 0)) {
+            braces += primary[end] == '{' ? 1 : primary[end] == '}' ? -1 : 0;
+            ++end;
+        }
+        std::string attribute = primary.substr(start, end - start);
+        size_t equals = attribute.find('=');
+        std::string key = attribute.substr(0, equals);
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        if (equals != std::string::npos && (key == "DATABASE" || key == "DB")) {
+            databaseName = attribute.substr(equals + 1);
+        }
+        else if (!attribute.empty()) {
+            derived += attribute + ";";
+        }
+        start = end + 1;
+    }
+
+    if (!server.empty()) {
+        return server;
+    }
+    return primary.empty() ? defaultServerConnectionString : derived;
+}
+
+static bool isPlainIdentifier(const std::string& name) {
+    return !name.empty() && std::all_of(name.begin(), name.end(),
+        [](unsigned char c) { return std::isalnum(c) || c == '_' || c == '$'; });
 }
 
-DatabaseManager::~DatabaseManager() {}
+static const int connectAttempts = 3;
+static const int loginTimeoutSeconds = 3;
+static const std::chrono::milliseconds backoffBase(100);
+static const std::chrono::milliseconds backoffCap(2000);
 
-bool DatabaseManager::connectToDatabase() {
-    hstmt = NULL;
-    ret = SQL_SUCCESS;
-    std::cout << "Connecting to the database..." << std::endl;
-    std::unique_lock<std::mutex> lock(logMutex);
-    logger.WriteLog("Connecting to the database...");
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+static std::atomic<bool> databaseChecked(false);
+
+// Full jitter: sleep a random time between zero and the exponential
+// bound so that sessions retrying after the same outage spread out.
+static std::chrono::milliseconds backoffDelay(int attempt) {
+    thread_local std::mt19937 generator(std::random_device{}());
+    long long bound = std::min<long long>(backoffCap.count(), backoffBase.count() << attempt);
+    std::uniform_int_distribution<long long> distribution(0, bound);
+    return std::chrono::milliseconds(distribution(generator));
+}
+
+DatabaseManager::DatabaseManager() : henv(nullptr), hdbc(nullptr), hstmt(nullptr), ret(SQL_SUCCESS), connected(false), sourceIndex(DataSourceRouter::primaryIndex) {
+    TraceSpan span("db.init");
+    if (!databaseChecked && checkAndCreateDatabase() && upgradeSchema()) {
+        databaseChecked = true;
+    }
+}
+
+// Callers that return early never call disconnectFromDatabase(), so the
+// handles are released here quietly instead of leaking the connection.
+DatabaseManager::~DatabaseManager() {
+    if (!connected) {
+        return;
+    }
+    SQLDisconnect(hdbc);
+    SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
+    SQLFreeHandle(SQL_HANDLE_ENV, henv);
+    if (sourceIndex != DataSourceRouter::noSource) {
+        DataSourceRouter::instance().release(sourceIndex);
+    }
+}
+
+bool DatabaseManager::openConnection(const std::wstring& connectionString) {
+    TraceSpan span("db.openConnection");
     ret = SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &henv);
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::cerr << "Failed to allocate environment handle." << std::endl;
-        logger.WriteLog("Failed to allocate environment handle.");
+        logger.Log<LogLevel::Error>("Failed to allocate environment handle.");
+        henv = NULL;
         return false;
     }
 
     ret = SQLSetEnvAttr(henv, SQL_ATTR_ODBC_VERSION, (SQLPOINTER)SQL_OV_ODBC3, 0);
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::cerr << "Failed to set ODBC version." << std::endl;
-        logger.WriteLog("Failed to set ODBC version.");
+        logger.Log<LogLevel::Error>("Failed to set ODBC version.");
         SQLFreeHandle(SQL_HANDLE_ENV, henv);
+        henv = NULL;
         return false;
     }
 
     ret = SQLAllocHandle(SQL_HANDLE_DBC, henv, &hdbc);
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::cerr << "Failed to allocate database connection handle." << std::endl;
-        logger.WriteLog("Failed to allocate database connection handle.");
+        logger.Log<LogLevel::Error>("Failed to allocate database connection handle.");
         SQLFreeHandle(SQL_HANDLE_ENV, henv);
+        henv = NULL;
+        hdbc = NULL;
         return false;
     }
 
-    std::wstring connectionString = L"DSN=chatdb;UID=root;PWD=root";
+    SQLSetConnectAttr(hdbc, SQL_ATTR_LOGIN_TIMEOUT, (SQLPOINTER)(SQLULEN)loginTimeoutSeconds, 0);
     ret = SQLDriverConnect(hdbc, NULL, (SQLWCHAR*)connectionString.c_str(), SQL_NTS, NULL, 0, NULL, SQL_DRIVER_COMPLETE);
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
         SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
         SQLFreeHandle(SQL_HANDLE_ENV, henv);
+        hdbc = NULL;
+        henv = NULL;
+        return false;
+    }
+    return true;
+}
 
-        if (!checkAndCreateDatabase()) {
-            std::cerr << "Failed to check and create database." << std::endl;
-            logger.WriteLog("Failed to check and create database.");
-            return false;
+bool DatabaseManager::isConnectionAlive() {
+    if (!connected) {
+        return false;
+    }
+    SQLUINTEGER dead = SQL_CD_TRUE;
+    ret = SQLGetConnectAttr(hdbc, SQL_ATTR_CONNECTION_DEAD, &dead, SQL_IS_UINTEGER, NULL);
+    return (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) && dead == SQL_CD_FALSE;
+}
+
+bool DatabaseManager::connectToSource(size_t source) {
+    return connectWithRetry(DataSourceRouter::instance().connectionString(source));
+}
+
+bool DatabaseManager::connectWithRetry(const std::wstring& connectionString) {
+    CircuitBreaker& breaker = circuitBreakerFor(connectionString);
+    if (!breaker.allowRequest()) {
+        std::cerr << "Database is unavailable, try again later." << std::endl;
+        logger.Log<LogLevel::Warn>("Database is unavailable, failing fast.");
+        return false;
+    }
+
+    // A half-open breaker admits a single probe, so no retries then.
+    int attempts = breaker.getState() == CircuitBreaker::State::Closed ? connectAttempts : 1;
+    for (int attempt = 0; attempt < attempts; ++attempt) {
+        if (attempt > 0) {
+            TraceSpan backoff("db.backoff");
+            std::this_thread::sleep_for(backoffDelay(attempt));
+        }
+        if (openConnection(connectionString)) {
+            breaker.recordSuccess();
+            return true;
+        }
+    }
+
+    breaker.recordFailure();
+    return false;
+}
+
+bool DatabaseManager::connectToDatabase(AccessMode mode, const std::string& session) {
+    TraceSpan span("db.connect");
+    hstmt = NULL;
+    ret = SQL_SUCCESS;
+    DataSourceRouter& router = DataSourceRouter::instance();
+    writeSession = mode == AccessMode::Write ? session : std::string();
+
+    if (connected) {
+        bool alive = isConnectionAlive();
+        bool routedHere = sourceIndex == DataSourceRouter::primaryIndex ||
+            (mode == AccessMode::Read && sourceIndex != DataSourceRouter::noSource);
+        if (alive && routedHere) {
+            return true;
         }
+        if (!alive) {
+            logger.Log<LogLevel::Warn>("Database connection lost, reconnecting...");
+        }
+        disconnectFromDatabase();
     }
 
-    std::cout << "Connected to the database." << std::endl;
-    logger.WriteLog("Connected to the database.");
+    if (logger.Enabled<LogLevel::Debug>()) {
+        std::cout << "Connecting to the database..." << std::endl;
+        logger.Log<LogLevel::Debug>("Connecting to the database...", logField("mode", mode == AccessMode::Read ? "read" : "write"));
+    }
+    {
+        TraceSpan sleep("db.connect.sleep");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    sourceIndex = router.acquire(mode, session);
+    bool opened = connectToSource(sourceIndex);
+    if (!opened && sourceIndex != DataSourceRouter::primaryIndex) {
+        logger.Log<LogLevel::Warn>("Replica unavailable, reading from the primary.", logField("replica", sourceIndex));
+        router.release(sourceIndex);
+        sourceIndex = router.acquire(AccessMode::Write, "");
+        opened = connectToSource(sourceIndex);
+    }
+    if (!opened) {
+        router.release(sourceIndex);
+        return false;
+    }
+
+    connected = true;
+    if (logger.Enabled<LogLevel::Debug>()) {
+        std::cout << "Connected to the database." << std::endl;
+        logger.Log<LogLevel::Debug>("Connected to the database.", logField("source", sourceIndex));
+    }
+    return true;
+}
+
+bool DatabaseManager::connectToDataSource(const std::wstring& connectionString) {
+    if (connected) {
+        disconnectFromDatabase();
+    }
+    writeSession.clear();
+    hstmt = NULL;
+    ret = SQL_SUCCESS;
 
-    return (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO);
+    if (!connectWithRetry(connectionString)) {
+        return false;
+    }
+    sourceIndex = DataSourceRouter::noSource;
+    connected = true;
+    logger.Log<LogLevel::Debug>("Connected to the data source.");
+    return true;
 }
 
 void DatabaseManager::disconnectFromDatabase() {
+    TraceSpan span("db.disconnect");
     if (hstmt) {
         SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
         hstmt = NULL;
     }
     std::cout << "Disconnecting from the database..." << std::endl;
-    logger.WriteLog("Disconnecting from the database...");
+    logger.Log<LogLevel::Debug>("Disconnecting from the database...");
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    {
+        TraceSpan sleep("db.disconnect.sleep");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
 
     if (hstmt) {
         SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
@@ -77,12 +334,20 @@ void DatabaseManager::disconnectFromDatabase() {
     if (hdbc) {
         SQLDisconnect(hdbc);
         std::cout << "Disconnected from the database." << std::endl;
-        logger.WriteLog("Disconnected from the database.");
+        logger.Log<LogLevel::Debug>("Disconnected from the database.");
         SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
+        hdbc = NULL;
     }
 
     if (henv) {
         SQLFreeHandle(SQL_HANDLE_ENV, henv);
+        henv = NULL;
+    }
+    if (connected) {
+        if (sourceIndex != DataSourceRouter::noSource) {
+            DataSourceRouter::instance().release(sourceIndex);
+        }
+        connected = false;
     }
 }
 
@@ -99,13 +364,13 @@ bool DatabaseManager::createTables() {
             "email VARCHAR(100) UNIQUE NOT NULL"
             ");";
         std::unique_lock<std::mutex> lock(logMutex);
-        logger.WriteLog("CREATE TABLE users.");
+        logger.Log<LogLevel::Debug>("CREATE TABLE users.");
         std::string queryCreatePasswords = "CREATE TABLE passwords ("
             "user_id INTEGER PRIMARY KEY,"
             "password_hash VARCHAR(32) NOT NULL,"
             "FOREIGN KEY (user_id) REFERENCES users(user_id)"
             ");";
-        logger.WriteLog("CREATE TABLE passwords.");
+        logger.Log<LogLevel::Debug>("CREATE TABLE passwords.");
         std::string queryCreateMessages = "CREATE TABLE messages ("
             "message_id INTEGER PRIMARY KEY AUTO_INCREMENT,"
             "sender_id INTEGER NOT NULL,"
@@ -116,77 +381,66 @@ bool DatabaseManager::createTables() {
             "FOREIGN KEY (sender_id) REFERENCES users(user_id),"
             "FOREIGN KEY (receiver_id) REFERENCES users(user_id)"
             ");";
-        logger.WriteLog("CREATE TABLE messages.");
-        std::string queryCreateUserTrigger = "CREATE TRIGGER register_user_trigger\n"
-            "AFTER INSERT ON users\n"
-            "FOR EACH ROW\n"
-            "BEGIN\n"
-            "    INSERT INTO passwords (user_id, password_hash) VALUES (NEW.user_id, 'pass');\n"
-            "END;";
-        logger.WriteLog("CREATE TRIGGER register_user_trigger.");
-        std::string queryCreateDeleteUserTrigger = "CREATE TRIGGER delete_user_trigger\n"
-            "BEFORE DELETE ON users\n"
-            "FOR EACH ROW\n"
-            "BEGIN\n"
-            "    DELETE FROM messages WHERE sender_id = OLD.user_id OR receiver_id = OLD.user_id;\n"
-            "    DELETE FROM passwords WHERE user_id = OLD.user_id;\n"
-            "END;";
-        logger.WriteLog("CREATE TRIGGER delete_user_trigger.");
+        logger.Log<LogLevel::Debug>("CREATE TABLE messages.");
+        std::string queryCreateUserTrigger = queryCreateRegisterUserTrigger;
+        logger.Log<LogLevel::Debug>("CREATE TRIGGER register_user_trigger.");
+        std::string queryCreateDeleteUserTrigger = queryCreateDeleteTrigger;
+        logger.Log<LogLevel::Debug>("CREATE TRIGGER delete_user_trigger.");
         ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
         ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryCreateUsers.c_str(), SQL_NTS);
 
         if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
             std::cerr << "Failed to create 'users' table." << std::endl;
-            logger.WriteLog("Failed to create 'users' table.");
+            logger.Log<LogLevel::Error>("Failed to create 'users' table.");
             disconnectFromDatabase();
             return false;
         }
         std::cout << "Table 'users' created." << std::endl;
-        logger.WriteLog("Table 'users' created.");
+        logger.Log<LogLevel::Info>("Table 'users' created.");
 
         ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryCreatePasswords.c_str(), SQL_NTS);
 
         if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
             std::cerr << "Failed to create 'passwords' table." << std::endl;
-            logger.WriteLog("Failed to create 'passwords' table.");
+            logger.Log<LogLevel::Error>("Failed to create 'passwords' table.");
             disconnectFromDatabase();
             return false;
         }
         std::cout << "Table 'passwords' created." << std::endl;
-        logger.WriteLog("Table 'passwords' created.");
+        logger.Log<LogLevel::Info>("Table 'passwords' created.");
 
         ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryCreateMessages.c_str(), SQL_NTS);
 
         if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
             std::cerr << "Failed to create 'messages' table." << std::endl;
-            logger.WriteLog("Failed to create 'messages' table.");
+            logger.Log<LogLevel::Error>("Failed to create 'messages' table.");
             disconnectFromDatabase();
             return false;
         }
         std::cout << "Table 'messages' created." << std::endl;
-        logger.WriteLog("Table 'messages' created.");
+        logger.Log<LogLevel::Info>("Table 'messages' created.");
 
         ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryCreateUserTrigger.c_str(), SQL_NTS);
 
         if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
             std::cerr << "Failed to create 'register_user_trigger' trigger." << std::endl;
-            logger.WriteLog("Failed to create 'register_user_trigger' trigger.");
+            logger.Log<LogLevel::Error>("Failed to create 'register_user_trigger' trigger.");
             disconnectFromDatabase();
             return false;
         }
         std::cout << "Trigger 'register_user_trigger' created." << std::endl;
-        logger.WriteLog("Trigger 'register_user_trigger' created.");
+        logger.Log<LogLevel::Info>("Trigger 'register_user_trigger' created.");
 
         ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryCreateDeleteUserTrigger.c_str(), SQL_NTS);
 
         if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
             std::cerr << "Failed to create 'delete_user_trigger' trigger." << std::endl;
-            logger.WriteLog("Failed to create 'delete_user_trigger' trigger.");
+            logger.Log<LogLevel::Error>("Failed to create 'delete_user_trigger' trigger.");
             disconnectFromDatabase();
             return false;
         }
         std::cout << "Trigger 'delete_user_trigger' created." << std::endl;
-        logger.WriteLog("Trigger 'delete_user_trigger' created.");
+        logger.Log<LogLevel::Info>("Trigger 'delete_user_trigger' created.");
 
         SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
         disconnectFromDatabase();
@@ -194,13 +448,123 @@ bool DatabaseManager::createTables() {
     }
     else {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
         return false;
     }
     system("cls");
 
 }
 
+bool DatabaseManager::executeStatement(const std::string& query) {
+    TraceSpan span("db.executeStatement");
+    SQLHANDLE hstmtExec;
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmtExec);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        return false;
+    }
+    ret = SQLExecDirectA(hstmtExec, (SQLCHAR*)query.c_str(), SQL_NTS);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmtExec);
+    return (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO || ret == SQL_NO_DATA);
+}
+
+void DatabaseManager::recordWrite() {
+    DataSourceRouter::instance().recordWrite(writeSession);
+}
+
+bool DatabaseManager::upgradeSchema() {
+    TraceSpan span("db.upgradeSchema");
+    if (!connectToDatabase()) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    for (const char* query : schemaUpgrades) {
+        if (!executeStatement(query)) {
+            std::cerr << "Failed to upgrade database schema." << std::endl;
+            logger.Log<LogLevel::Error>("Failed to upgrade database schema.");
+            disconnectFromDatabase();
+            return false;
+        }
+    }
+    // Conversations from before the inbox existed.
+    if (!InboxManager::rebuild(*this, true)) {
+        disconnectFromDatabase();
+        return false;
+    }
+
+    for (const ColumnUpgrade& upgrade : columnUpgrades) {
+        std::string queryColumn = "SELECT COUNT(*) FROM INFORMATION_SCHEMA.COLUMNS "
+            "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = ? AND COLUMN_NAME = ?";
+        SQLINTEGER columnCount = 0;
+        ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+        ret = SQLPrepareA(hstmt, (SQLCHAR*)queryColumn.c_str(), SQL_NTS);
+        ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 64, 0, (SQLCHAR*)upgrade.table, 0, NULL);
+        ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 64, 0, (SQLCHAR*)upgrade.column, 0, NULL);
+        ret = SQLExecute(hstmt);
+        bool checked = (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) && SQLFetch(hstmt) == SQL_SUCCESS;
+        if (checked) {
+            SQLGetData(hstmt, 1, SQL_C_SLONG, &columnCount, sizeof(columnCount), NULL);
+        }
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+        if (!checked || (columnCount == 0 && !executeStatement(upgrade.alter))) {
+            std::cerr << "Failed to upgrade database schema." << std::endl;
+            logger.Log<LogLevel::Error>("Failed to upgrade database schema.");
+            disconnectFromDatabase();
+            return false;
+        }
+    }
+
+    // Older databases have a delete_user_trigger that also deletes the
+    // user's messages in one statement; the purger does that in chunks,
+    // so the trigger is recreated without it.
+    std::string queryTrigger = "SELECT COUNT(*) FROM INFORMATION_SCHEMA.TRIGGERS "
+        "WHERE TRIGGER_SCHEMA = DATABASE() AND TRIGGER_NAME = 'delete_user_trigger' "
+        "AND ACTION_STATEMENT LIKE '%messages%'";
+    SQLINTEGER oldTriggers = 0;
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryTrigger.c_str(), SQL_NTS);
+    bool checked = (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) && SQLFetch(hstmt) == SQL_SUCCESS;
+    if (checked) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &oldTriggers, sizeof(oldTriggers), NULL);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    if (!checked || (oldTriggers > 0 &&
+        (!executeStatement("DROP TRIGGER IF EXISTS delete_user_trigger") || !executeStatement(queryCreateDeleteTrigger)))) {
+        std::cerr << "Failed to upgrade database schema." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to upgrade 'delete_user_trigger' trigger.");
+        disconnectFromDatabase();
+        return false;
+    }
+
+    logger.Log<LogLevel::Debug>("Database schema is up to date.");
+    disconnectFromDatabase();
+    return true;
+}
+
+bool DatabaseManager::dropTriggers() {
+    if (!executeStatement("DROP TRIGGER IF EXISTS register_user_trigger") ||
+        !executeStatement("DROP TRIGGER IF EXISTS delete_user_trigger")) {
+        std::cerr << "Failed to drop triggers." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to drop triggers.");
+        return false;
+    }
+    logger.Log<LogLevel::Info>("Triggers dropped.");
+    return true;
+}
+
+bool DatabaseManager::createTriggers() {
+    if (!executeStatement(queryCreateRegisterUserTrigger) ||
+        !executeStatement(queryCreateDeleteTrigger)) {
+        std::cerr << "Failed to create triggers." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to create triggers.");
+        return false;
+    }
+    logger.Log<LogLevel::Info>("Triggers created.");
+    return true;
+}
+
 bool DatabaseManager::insertDataIntoTable() {
     if (connectToDatabase()) {
         ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
@@ -217,11 +581,11 @@ bool DatabaseManager::insertDataIntoTable() {
 
         if (ret == SQL_SUCCESS && rowCount > 0) {
             std::cout << "Data inserted into 'users' table." << std::endl;
-            logger.WriteLog("Data inserted into 'users' table.");
+            logger.Log<LogLevel::Info>("Data inserted into 'users' table.");
         }
         else {
             std::cerr << "Failed to insert data into 'users' table." << std::endl;
-            logger.WriteLog("Failed to insert data into 'users' table.");
+            logger.Log<LogLevel::Error>("Failed to insert data into 'users' table.");
             disconnectFromDatabase();
             return false;
         }
@@ -237,11 +601,11 @@ bool DatabaseManager::insertDataIntoTable() {
 
         if (ret == SQL_SUCCESS && rowCount > 0) {
             std::cout << "Data inserted into 'messages' table." << std::endl;
-            logger.WriteLog("Data inserted into 'messages' table.");
+            logger.Log<LogLevel::Info>("Data inserted into 'messages' table.");
         }
         else {
             std::cerr << "Failed to insert data into 'messages' table." << std::endl;
-            logger.WriteLog("Failed to insert data into 'messages' table.");
+            logger.Log<LogLevel::Error>("Failed to insert data into 'messages' table.");
             disconnectFromDatabase();
             return false;
         }
@@ -252,42 +616,61 @@ bool DatabaseManager::insertDataIntoTable() {
     }
     else {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
         return false;
     }
 }
 
 bool DatabaseManager::checkAndCreateDatabase() {
+    TraceSpan span("db.checkAndCreateDatabase");
     std::wcout << L"Initializing ODBC environment..." << std::endl;
-    logger.WriteLog("Initializing ODBC environment...");
+    logger.Log<LogLevel::Debug>("Initializing ODBC environment...");
     ret = SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &henv);
     ret = SQLSetEnvAttr(henv, SQL_ATTR_ODBC_VERSION, (SQLPOINTER)SQL_OV_ODBC3, 0);
     ret = SQLAllocHandle(SQL_HANDLE_DBC, henv, &hdbc);
 
     std::wcout << L"Connecting to MySQL server..." << std::endl;
-    logger.WriteLog("Connecting to MySQL server...");
-    SQLWCHAR connStr[] = L"DRIVER={MySQL ODBC 8.0 ANSI Driver};"
-        L"SERVER=localhost;"
-        L"USER=root;"
-        L"PASSWORD=root;"
-        L"OPTION=3;";
-
-    ret = SQLDriverConnectW(hdbc, NULL, connStr, SQL_NTS, NULL, 0, NULL, SQL_DRIVER_NOPROMPT);
+    logger.Log<LogLevel::Debug>("Connecting to MySQL server...");
+
+    std::string databaseName;
+    std::wstring serverConnection = toWide(serverConnectionString(databaseName));
+    if (!isPlainIdentifier(databaseName)) {
+        std::cerr << "Invalid database name '" << databaseName << "' in the primary connection string." << std::endl;
+        logger.Log<LogLevel::Error>("Invalid database name in the primary connection string.", logField("database", databaseName));
+        SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
+        SQLFreeHandle(SQL_HANDLE_ENV, henv);
+        return false;
+    }
+    std::wstring wideDatabaseName = toWide(databaseName);
+
+    CircuitBreaker& breaker = circuitBreakerFor(serverConnection);
+    if (!breaker.allowRequest()) {
+        std::wcerr << L"MySQL server is unavailable, try again later." << std::endl;
+        logger.Log<LogLevel::Warn>("MySQL server is unavailable, failing fast.");
+        SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
+        SQLFreeHandle(SQL_HANDLE_ENV, henv);
+        return false;
+    }
+
+    SQLSetConnectAttr(hdbc, SQL_ATTR_LOGIN_TIMEOUT, (SQLPOINTER)(SQLULEN)loginTimeoutSeconds, 0);
+    ret = SQLDriverConnectW(hdbc, NULL, (SQLWCHAR*)serverConnection.c_str(), SQL_NTS, NULL, 0, NULL, SQL_DRIVER_NOPROMPT);
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::wcerr << L"Failed to connect to the MySQL server." << std::endl;
-        logger.WriteLog("Failed to connect to the MySQL server.");
+        logger.Log<LogLevel::Error>("Failed to connect to the MySQL server.");
+        breaker.recordFailure();
         SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
         SQLFreeHandle(SQL_HANDLE_ENV, henv);
         return false;
     }
+    breaker.recordSuccess();
 
-    std::wstring checkDbQuery = L"SELECT SCHEMA_NAME FROM INFORMATION_SCHEMA.SCHEMATA WHERE SCHEMA_NAME = 'chatdb'";
+    std::wstring checkDbQuery = L"SELECT SCHEMA_NAME FROM INFORMATION_SCHEMA.SCHEMATA WHERE SCHEMA_NAME = '" + wideDatabaseName + L"'";
     ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
     ret = SQLExecDirectW(hstmt, (SQLWCHAR*)checkDbQuery.c_str(), SQL_NTS);
 
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::wcerr << L"Failed to execute the database existence check query." << std::endl;
-        logger.WriteLog("Failed to execute the database existence check query.");
+        logger.Log<LogLevel::Error>("Failed to execute the database existence check query.");
         SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
         SQLDisconnect(hdbc);
         SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
@@ -300,14 +683,14 @@ bool DatabaseManager::checkAndCreateDatabase() {
 
     if (rowCount == 0) {
 
-        std::wstring createDbQuery = L"CREATE DATABASE chatdb";
-        std::wcout << L"Creating 'chatdb' database..." << std::endl;
-        logger.WriteLog("Creating 'chatdb' database...");
+        std::wstring createDbQuery = L"CREATE DATABASE " + wideDatabaseName;
+        std::wcout << L"Creating '" << wideDatabaseName << L"' database..." << std::endl;
+        logger.Log<LogLevel::Info>("Creating database...", logField("database", databaseName));
         ret = SQLExecDirectW(hstmt, (SQLWCHAR*)createDbQuery.c_str(), SQL_NTS);
 
         if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
-            std::wcerr << L"Failed to create 'chatdb' database." << std::endl;
-            logger.WriteLog("Failed to create 'chatdb' database.");
+            std::wcerr << L"Failed to create '" << wideDatabaseName << L"' database." << std::endl;
+            logger.Log<LogLevel::Error>("Failed to create database.", logField("database", databaseName));
             SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
             SQLDisconnect(hdbc);
             SQLFreeHandle(SQL_HANDLE_DBC, hdbc);
@@ -315,14 +698,14 @@ bool DatabaseManager::checkAndCreateDatabase() {
             return false;
         }
 
-        std::wcout << L"Database 'chatdb' created." << std::endl;
-        logger.WriteLog("Database 'chatdb' created.");
+        std::wcout << L"Database '" << wideDatabaseName << L"' created." << std::endl;
+        logger.Log<LogLevel::Info>("Database created.", logField("database", databaseName));
         createTables();
         insertDataIntoTable();
     }
     else {
-        std::wcout << L"Connection to database 'chatdb' established." << std::endl;
-        logger.WriteLog("Connection to database 'chatdb' established.");
+        std::wcout << L"Connection to database '" << wideDatabaseName << L"' established." << std::endl;
+        logger.Log<LogLevel::Debug>("Connection to database established.", logField("database", databaseName));
     }
 
     SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
@@ -2,6 +2,8 @@
 #include <windows.h>
 #include <sqlext.h>
 #include <iostream>
+#include <string>
+#include "router.h"
 
 class DatabaseManager {
 private:
@@ -9,14 +11,30 @@ private:
     SQLHANDLE henv;
     SQLHANDLE hdbc;
     SQLHANDLE hstmt;
+    bool connected;
+    size_t sourceIndex;
+    // The session of a Write connection, pinned to the primary by
+    // recordWrite(); empty for reads and direct data sources.
+    std::string writeSession;
+    bool openConnection(const std::wstring& connectionString);
+    bool connectToSource(size_t source);
+    bool connectWithRetry(const std::wstring& connectionString);
 public:
     DatabaseManager();
     ~DatabaseManager();
-    bool connectToDatabase();
+    bool connectToDatabase(AccessMode mode = AccessMode::Write, const std::string& session = "");
+    bool connectToDataSource(const std::wstring& connectionString);
+    bool isConnectionAlive();
     void disconnectFromDatabase();
     bool createTables();
     bool insertDataIntoTable();
     bool checkAndCreateDatabase();
+    bool upgradeSchema();
+    bool executeStatement(const std::string& query);
+    // Call once a write has committed, so the session's next reads see it.
+    void recordWrite();
+    bool dropTriggers();
+    bool createTriggers();
     SQLHANDLE getHDBC() const {
         return hdbc;
     }
@@ -0,0 +1,345 @@
+#include "historycache.h"
+#include "database.h"
+#include "config.h"
+#include "logger.h"
+#include "shards.h"
+#include "users.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <map>
+
+static const uint32_t cacheVersion = 2;
+static const uint8_t recordIncomplete = 1;
+static const size_t maxUserIds = 16;
+static const size_t maxShards = 64;
+
+struct HistoryCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t capacity;
+    uint32_t shardCount;
+    uint32_t generation;
+    uint32_t synced;
+    uint32_t userIdCount;
+    int32_t userIds[maxUserIds];
+    int32_t lastMessageId[maxShards];
+    uint64_t appended;
+};
+
+struct HistoryCacheRecord {
+    int32_t messageId;
+    uint16_t textLength;
+    uint8_t timestampLength;
+    uint8_t flags;
+    char timestamp[24];
+    char text[992];
+};
+
+static_assert(sizeof(HistoryCacheRecord) == 1024, "cache records are fixed at 1 KB");
+
+static std::mutex registryMutex;
+static std::map<std::string, std::shared_ptr<HistoryCache>> openCaches;
+
+static std::string cachePath(const std::string& username) {
+    static const char digits[] = "0123456789abcdef";
+    std::string name;
+    for (unsigned char c : username) {
+        name += digits[c >> 4];
+        name += digits[c & 15];
+    }
+    return config.get("cache_dir", "cache") + "/" + name + ".hist";
+}
+
+// Newest rows past the cursor, oldest first; at most "limit" of them,
+// since older ones would fall out of the ring anyway.
+static bool fetchNewMessages(SQLHANDLE hdbc, const std::vector<SQLINTEGER>& userIds, SQLINTEGER afterId,
+    uint32_t limit, std::vector<CachedMessage>& messages) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryNew = "SELECT message_id, message_text, send_date FROM messages WHERE sender_id IN (?";
+    for (size_t i = 1; i < userIds.size(); ++i) {
+        queryNew += ", ?";
+    }
+    queryNew += ") AND message_id > ? ORDER BY message_id DESC LIMIT " + std::to_string(limit);
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryNew.c_str(), SQL_NTS);
+    for (size_t i = 0; i < userIds.size(); ++i) {
+        ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(i + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, (SQLPOINTER)&userIds[i], 0, NULL);
+    }
+    ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(userIds.size() + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &afterId, 0, NULL);
+    ret = SQLExecute(hstmt);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    SQLINTEGER messageId;
+    SQLCHAR message[1000], timestamp[50];
+    SQLLEN messageIdLen, messageLen, timestampLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &messageId, sizeof(messageId), &messageIdLen);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, message, sizeof(message), &messageLen);
+        SQLGetData(hstmt, 3, SQL_C_CHAR, timestamp, sizeof(timestamp), &timestampLen);
+        messages.push_back({ messageId, (char*)timestamp, (char*)message });
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    std::reverse(messages.begin(), messages.end());
+    return true;
+}
+
+std::shared_ptr<HistoryCache> HistoryCache::open(const std::string& username) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto found = openCaches.find(username);
+    if (found != openCaches.end()) {
+        return found->second;
+    }
+
+    std::shared_ptr<HistoryCache> cache(new HistoryCache(cachePath(username)));
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cache->filePath).parent_path(), error);
+    if (!cache->map(sizeof(HistoryCacheHeader) + size_t(cache->capacity) * sizeof(HistoryCacheRecord))) {
+        logger.Log<LogLevel::Warn>("History cache unavailable.", logField("path", cache->filePath));
+        return nullptr;
+    }
+    openCaches[username] = cache;
+    return cache;
+}
+
+void HistoryCache::close(const std::string& username) {
+    std::shared_ptr<HistoryCache> cache;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto found = openCaches.find(username);
+        if (found == openCaches.end()) {
+            return;
+        }
+        cache = found->second;
+        openCaches.erase(found);
+    }
+    cache->waitForSync();
+}
+
+void HistoryCache::invalidate(const std::string& username) {
+    std::shared_ptr<HistoryCache> cache;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto found = openCaches.find(username);
+        if (found != openCaches.end()) {
+            cache = found->second;
+            openCaches.erase(found);
+        }
+    }
+    if (cache) {
+        // Anyone still holding the mapping sees an empty, cold cache.
+        cache->waitForSync();
+        {
+            std::lock_guard<std::mutex> lock(cache->dataMutex);
+            cache->reset({}, 0);
+        }
+        cache->unmap();
+    }
+    if (!DeleteFileA(cachePath(username).c_str())) {
+        logger.Log<LogLevel::Debug>("No history cache to delete.", logField("user", username));
+    }
+}
+
+HistoryCache::HistoryCache(const std::string& filePath)
+    : filePath(filePath), file(INVALID_HANDLE_VALUE), mapping(NULL), view(nullptr), syncing(false) {
+    capacity = static_cast<uint32_t>(std::max(1, config.getInt("history_cache_messages", 500)));
+}
+
+HistoryCache::~HistoryCache() {
+    waitForSync();
+    unmap();
+}
+
+bool HistoryCache::map(size_t fileSize) {
+    file = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    DWORD existingSize = GetFileSize(file, NULL);
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, static_cast<DWORD>(fileSize), NULL);
+    if (mapping == NULL) {
+        unmap();
+        return false;
+    }
+    view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, fileSize);
+    if (view == nullptr) {
+        unmap();
+        return false;
+    }
+
+    HistoryCacheHeader* header = static_cast<HistoryCacheHeader*>(view);
+    if (existingSize < fileSize || memcmp(header->magic, "CHATHIST", 8) != 0 || header->version != cacheVersion ||
+        header->recordSize != sizeof(HistoryCacheRecord) || header->capacity != capacity) {
+        reset({}, 0);
+    }
+    return true;
+}
+
+void HistoryCache::unmap() {
+    std::lock_guard<std::mutex> lock(dataMutex);
+    if (view != nullptr) {
+        FlushViewOfFile(view, 0);
+        UnmapViewOfFile(view);
+        view = nullptr;
+    }
+    if (mapping != NULL) {
+        CloseHandle(mapping);
+        mapping = NULL;
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+}
+
+// Caller holds dataMutex, except while the cache is still private to map().
+void HistoryCache::reset(const std::vector<int>& userIds, size_t shardCount) {
+    if (view == nullptr) {
+        return;
+    }
+    HistoryCacheHeader* header = static_cast<HistoryCacheHeader*>(view);
+    uint32_t generation = memcmp(header->magic, "CHATHIST", 8) == 0 ? header->generation + 1 : 0;
+    memset(header, 0, sizeof(HistoryCacheHeader));
+    memcpy(header->magic, "CHATHIST", 8);
+    header->version = cacheVersion;
+    header->recordSize = sizeof(HistoryCacheRecord);
+    header->capacity = capacity;
+    header->shardCount = static_cast<uint32_t>(shardCount);
+    header->generation = generation;
+    header->userIdCount = static_cast<uint32_t>(userIds.size());
+    std::copy(userIds.begin(), userIds.end(), header->userIds);
+}
+
+bool HistoryCache::isWarm() {
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return view != nullptr && static_cast<HistoryCacheHeader*>(view)->synced != 0;
+}
+
+uint64_t HistoryCache::read(uint64_t from, std::vector<CachedMessage>& messages) {
+    std::lock_guard<std::mutex> lock(dataMutex);
+    if (view == nullptr) {
+        return from;
+    }
+    const HistoryCacheHeader* header = static_cast<const HistoryCacheHeader*>(view);
+    const HistoryCacheRecord* records = reinterpret_cast<const HistoryCacheRecord*>(header + 1);
+    uint64_t appended = header->appended;
+    uint64_t oldest = appended > capacity ? appended - capacity : 0;
+
+    for (uint64_t sequence = std::max(from, oldest); sequence < appended; ++sequence) {
+        const HistoryCacheRecord& record = records[sequence % capacity];
+        messages.push_back({ record.messageId,
+            std::string(record.timestamp, std::min<size_t>(record.timestampLength, sizeof(record.timestamp))),
+            std::string(record.text, std::min<size_t>(record.textLength, sizeof(record.text))),
+            (record.flags & recordIncomplete) == 0 });
+    }
+    return appended;
+}
+
+bool HistoryCache::sync(const std::string& username) {
+    TraceSpan span("historyCache.sync");
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Read, username)) {
+        return false;
+    }
+
+    std::vector<SQLINTEGER> userIds;
+    MessageShards& shards = MessageShards::instance();
+    if (!UserManager::findUserIds(dbManager.getHDBC(), username, userIds) ||
+        userIds.size() > maxUserIds || shards.count() > maxShards) {
+        dbManager.disconnectFromDatabase();
+        return false;
+    }
+    std::sort(userIds.begin(), userIds.end());
+
+    // A different set of user ids means the name was deleted and
+    // registered again, possibly by another process: start over.
+    std::vector<SQLINTEGER> cursors;
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        if (view == nullptr) {
+            dbManager.disconnectFromDatabase();
+            return false;
+        }
+        HistoryCacheHeader* header = static_cast<HistoryCacheHeader*>(view);
+        std::vector<int> cachedIds(header->userIds, header->userIds + header->userIdCount);
+        if (cachedIds != std::vector<int>(userIds.begin(), userIds.end()) || header->shardCount != shards.count()) {
+            reset(std::vector<int>(userIds.begin(), userIds.end()), shards.count());
+        }
+        cursors.assign(header->lastMessageId, header->lastMessageId + shards.count());
+    }
+
+    std::vector<std::vector<CachedMessage>> shardMessages(shards.count());
+    bool ok = userIds.empty() || shards.forEachShard([&](size_t shard, SQLHANDLE hdbc) {
+        return fetchNewMessages(hdbc, userIds, cursors[shard], capacity, shardMessages[shard]);
+    }, AccessMode::Read, username, &dbManager);
+    dbManager.disconnectFromDatabase();
+    if (!ok) {
+        logger.Log<LogLevel::Warn>("History cache sync failed.", logField("user", username));
+        return false;
+    }
+
+    std::vector<CachedMessage> messages;
+    for (size_t shard = 0; shard < shardMessages.size(); ++shard) {
+        if (!shardMessages[shard].empty()) {
+            cursors[shard] = shardMessages[shard].back().messageId;
+        }
+        size_t middle = messages.size();
+        messages.insert(messages.end(), shardMessages[shard].begin(), shardMessages[shard].end());
+        std::inplace_merge(messages.begin(), messages.begin() + middle, messages.end(),
+            [](const CachedMessage& a, const CachedMessage& b) { return a.timestamp < b.timestamp; });
+    }
+
+    std::lock_guard<std::mutex> lock(dataMutex);
+    if (view == nullptr) {
+        return false;
+    }
+    HistoryCacheHeader* header = static_cast<HistoryCacheHeader*>(view);
+    HistoryCacheRecord* records = reinterpret_cast<HistoryCacheRecord*>(header + 1);
+    for (const CachedMessage& message : messages) {
+        HistoryCacheRecord& record = records[header->appended % capacity];
+        record.messageId = message.messageId;
+        record.timestampLength = static_cast<uint8_t>(std::min(message.timestamp.size(), sizeof(record.timestamp)));
+        record.textLength = static_cast<uint16_t>(std::min(message.text.size(), sizeof(record.text)));
+        memcpy(record.timestamp, message.timestamp.data(), record.timestampLength);
+        memcpy(record.text, message.text.data(), record.textLength);
+        record.flags = message.text.size() > sizeof(record.text) ? recordIncomplete : 0;
+        ++header->appended;
+    }
+    std::copy(cursors.begin(), cursors.end(), header->lastMessageId);
+    header->synced = 1;
+    FlushViewOfFile(view, 0);
+    logger.Log<LogLevel::Debug>("History cache synced.", logField("user", username), logField("new_messages", messages.size()));
+    return true;
+}
+
+void HistoryCache::startSync(const std::string& username) {
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (syncing) {
+        return;
+    }
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+    syncing = true;
+    uint64_t traceId = currentTraceId();
+    syncThread = std::thread([this, username, traceId]() {
+        TraceContext context(traceId);
+        sync(username);
+        syncing = false;
+    });
+}
+
+void HistoryCache::waitForSync() {
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+}
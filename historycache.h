@@ -0,0 +1,70 @@
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Cache file layout (cache_dir/<hex user name>.hist, memory-mapped):
+//   header:  "CHATHIST" | version | record size | capacity | shard count
+//            | generation | synced | user id count | user ids[16]
+//            | last message_id per shard[64] | uint64 records appended
+//   records: capacity fixed-size slots used as a ring; record n lives in
+//            slot n % capacity. "appended" is written after the record,
+//            so a torn append is simply not visible. A record whose text
+//            was cut to fit is flagged incomplete.
+
+struct CachedMessage {
+    int messageId;
+    std::string timestamp;
+    std::string text;
+    // False when the text did not fit in a record and only its start
+    // was cached; such messages must be read from the database.
+    bool complete = true;
+};
+
+// Per-user copy of the most recent sent messages. The first screen of
+// "Read Messages" is rendered straight from the mapped file; sync(),
+// run in the background, fetches only rows past each shard's last
+// cached message_id.
+class HistoryCache {
+public:
+    // Maps the user's cache file, or returns nullptr when it cannot be
+    // mapped. The mapping stays open until close().
+    static std::shared_ptr<HistoryCache> open(const std::string& username);
+    static void close(const std::string& username);
+    // Drops the user's cache file; called when the user is deleted.
+    static void invalidate(const std::string& username);
+
+    ~HistoryCache();
+
+    bool isWarm();
+    // Copies records from sequence number "from" on; returns the
+    // sequence number to pass next time.
+    uint64_t read(uint64_t from, std::vector<CachedMessage>& messages);
+
+    bool sync(const std::string& username);
+    void startSync(const std::string& username);
+    void waitForSync();
+
+private:
+    HistoryCache(const std::string& filePath);
+
+    bool map(size_t fileSize);
+    void unmap();
+    void reset(const std::vector<int>& userIds, size_t shardCount);
+
+    std::string filePath;
+    uint32_t capacity;
+    HANDLE file;
+    HANDLE mapping;
+    void* view;
+
+    std::mutex dataMutex;
+    std::mutex syncMutex;
+    std::thread syncThread;
+    std::atomic<bool> syncing;
+};
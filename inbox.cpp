@@ -0,0 +1,294 @@
+#include "inbox.h"
+#include "database.h"
+#include "logger.h"
+#include "retention.h"
+#include "shards.h"
+#include "trace.h"
+#include "users.h"
+#include <algorithm>
+#include <map>
+
+static const int previewLength = 100;
+static const int conversationLimit = 50;
+static const int conversationMessages = 50;
+
+static bool succeeded(SQLRETURN ret) {
+    return ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO;
+}
+
+bool InboxManager::recordMessage(SQLHANDLE hdbc, SQLINTEGER senderId, SQLINTEGER receiverId, SQLINTEGER messageId, const std::string& messageText) {
+    TraceSpan span("inbox.recordMessage");
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryUpsertInbox = "INSERT INTO inbox (user_id, peer_id, last_message_id, preview, last_date, unread_count) "
+        "VALUES (?, ?, ?, LEFT(?, " + std::to_string(previewLength) + "), CURRENT_TIMESTAMP, 0), "
+        "(?, ?, ?, LEFT(?, " + std::to_string(previewLength) + "), CURRENT_TIMESTAMP, ?) "
+        "ON DUPLICATE KEY UPDATE unread_count = unread_count + VALUES(unread_count), "
+        "last_message_id = VALUES(last_message_id), preview = VALUES(preview), last_date = VALUES(last_date)";
+    // A note to self lands on the same row twice; it should not count as unread.
+    SQLINTEGER receiverUnread = senderId == receiverId ? 0 : 1;
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryUpsertInbox.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &senderId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &receiverId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 3, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &messageId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 4, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 1000, 0, (SQLCHAR*)messageText.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 5, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &receiverId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 6, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &senderId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 7, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &messageId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 8, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 1000, 0, (SQLCHAR*)messageText.c_str(), 0, NULL);
+    ret = SQLBindParameter(hstmt, 9, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &receiverUnread, 0, NULL);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return succeeded(ret);
+}
+
+bool InboxManager::rebuild(DatabaseManager& dbManager, bool onlyIfEmpty) {
+    TraceSpan span("inbox.rebuild");
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    if (onlyIfEmpty) {
+        SQLHANDLE hstmt;
+        SQLRETURN ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+        ret = SQLExecDirectA(hstmt, (SQLCHAR*)"SELECT 1 FROM inbox LIMIT 1", SQL_NTS);
+        bool checked = succeeded(ret);
+        bool empty = checked && SQLFetch(hstmt) == SQL_NO_DATA;
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        if (!checked) {
+            return false;
+        }
+        if (!empty) {
+            return true;
+        }
+    }
+
+    // Each message counts for both directions of its conversation; the
+    // newest one per (user, peer) becomes the row.
+    std::string queryRebuild = "INSERT INTO inbox (user_id, peer_id, last_message_id, preview, last_date, unread_count) "
+        "SELECT c.user_id, c.peer_id, m.message_id, LEFT(m.message_text, " + std::to_string(previewLength) + "), m.send_date, 0 "
+        "FROM (SELECT user_id, peer_id, MAX(message_id) AS last_id FROM ("
+        "SELECT sender_id AS user_id, receiver_id AS peer_id, message_id FROM messages "
+        "UNION ALL SELECT receiver_id, sender_id, message_id FROM messages) d GROUP BY user_id, peer_id) c "
+        "JOIN messages m ON m.message_id = c.last_id";
+    if ((!onlyIfEmpty && !dbManager.executeStatement("TRUNCATE TABLE inbox")) || !dbManager.executeStatement(queryRebuild)) {
+        std::cerr << "Failed to rebuild the inbox." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to rebuild the inbox.");
+        return false;
+    }
+    logger.Log<LogLevel::Info>("Inbox rebuilt from messages.");
+    return true;
+}
+
+static bool fetchInbox(SQLHANDLE hdbc, size_t shard, const std::vector<SQLINTEGER>& userIds, std::vector<Conversation>& conversations) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryInbox = "SELECT user_id, peer_id, last_message_id, unread_count, preview, last_date "
+        "FROM inbox WHERE user_id IN (?";
+    for (size_t i = 1; i < userIds.size(); ++i) {
+        queryInbox += ", ?";
+    }
+    queryInbox += ") ORDER BY last_date DESC LIMIT " + std::to_string(conversationLimit);
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryInbox.c_str(), SQL_NTS);
+    for (size_t i = 0; i < userIds.size(); ++i) {
+        ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(i + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, (SQLPOINTER)&userIds[i], 0, NULL);
+    }
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+    if (!succeeded(ret)) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    Conversation conversation;
+    conversation.shard = shard;
+    SQLCHAR preview[previewLength * 4 + 1], lastDate[50];
+    SQLLEN previewLen, lastDateLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &conversation.userId, sizeof(conversation.userId), NULL);
+        SQLGetData(hstmt, 2, SQL_C_SLONG, &conversation.peerId, sizeof(conversation.peerId), NULL);
+        SQLGetData(hstmt, 3, SQL_C_SLONG, &conversation.lastMessageId, sizeof(conversation.lastMessageId), NULL);
+        SQLGetData(hstmt, 4, SQL_C_SLONG, &conversation.unreadCount, sizeof(conversation.unreadCount), NULL);
+        SQLGetData(hstmt, 5, SQL_C_CHAR, preview, sizeof(preview), &previewLen);
+        SQLGetData(hstmt, 6, SQL_C_CHAR, lastDate, sizeof(lastDate), &lastDateLen);
+        conversation.preview = (char*)preview;
+        conversation.lastDate = (char*)lastDate;
+        conversations.push_back(conversation);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+static bool fetchNames(SQLHANDLE hdbc, const std::vector<SQLINTEGER>& userIds, std::map<SQLINTEGER, std::string>& names) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryNames = "SELECT user_id, first_name FROM users WHERE deleted_at IS NULL AND user_id IN (?";
+    for (size_t i = 1; i < userIds.size(); ++i) {
+        queryNames += ", ?";
+    }
+    queryNames += ")";
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryNames.c_str(), SQL_NTS);
+    for (size_t i = 0; i < userIds.size(); ++i) {
+        ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(i + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, (SQLPOINTER)&userIds[i], 0, NULL);
+    }
+    ret = SQLExecute(hstmt);
+    if (!succeeded(ret)) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    SQLINTEGER userId;
+    SQLCHAR firstName[51];
+    SQLLEN firstNameLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &userId, sizeof(userId), NULL);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, firstName, sizeof(firstName), &firstNameLen);
+        names[userId] = (char*)firstName;
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+bool InboxManager::listConversations(const std::string& first_name, std::vector<Conversation>& conversations) {
+    TraceSpan span("inbox.listConversations");
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Read, first_name)) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    std::vector<SQLINTEGER> userIds;
+    MessageShards& shards = MessageShards::instance();
+    std::vector<std::vector<Conversation>> shardConversations(shards.count());
+    bool ok = UserManager::findUserIds(dbManager.getHDBC(), first_name, userIds);
+    if (ok && !userIds.empty()) {
+        ok = shards.forEachShard([&](size_t shard, SQLHANDLE hdbc) {
+            return fetchInbox(hdbc, shard, userIds, shardConversations[shard]);
+        }, AccessMode::Read, first_name, &dbManager);
+    }
+
+    conversations.clear();
+    for (const std::vector<Conversation>& shard : shardConversations) {
+        size_t middle = conversations.size();
+        conversations.insert(conversations.end(), shard.begin(), shard.end());
+        std::inplace_merge(conversations.begin(), conversations.begin() + middle, conversations.end(),
+            [](const Conversation& a, const Conversation& b) { return a.lastDate > b.lastDate; });
+    }
+    if (conversations.size() > static_cast<size_t>(conversationLimit)) {
+        conversations.resize(conversationLimit);
+    }
+
+    std::vector<SQLINTEGER> peerIds;
+    for (const Conversation& conversation : conversations) {
+        peerIds.push_back(conversation.peerId);
+    }
+    std::map<SQLINTEGER, std::string> names;
+    if (ok && !peerIds.empty()) {
+        ok = fetchNames(dbManager.getHDBC(), peerIds, names);
+    }
+    dbManager.disconnectFromDatabase();
+
+    if (!ok) {
+        std::cerr << "Failed to list conversations." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to list conversations.");
+        return false;
+    }
+
+    for (Conversation& conversation : conversations) {
+        auto name = names.find(conversation.peerId);
+        conversation.peerName = name != names.end() ? name->second : "(deleted)";
+    }
+    return true;
+}
+
+bool InboxManager::openConversation(const std::string& first_name, const Conversation& conversation) {
+    TraceSpan span("inbox.openConversation");
+    MessageShards& shards = MessageShards::instance();
+    DatabaseManager dbManager;
+    if (!shards.connect(dbManager, conversation.shard, AccessMode::Write, first_name)) {
+        std::cerr << "Failed to connect to message shard." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to message shard.");
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    SQLINTEGER userId = conversation.userId, peerId = conversation.peerId;
+    std::string queryConversation = "SELECT sender_id, message_text, send_date FROM messages "
+        "WHERE (sender_id = ? AND receiver_id = ?) OR (sender_id = ? AND receiver_id = ?) "
+        "ORDER BY message_id DESC LIMIT " + std::to_string(conversationMessages);
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryConversation.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &userId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &peerId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 3, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &peerId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 4, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &userId, 0, NULL);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+    if (!succeeded(ret)) {
+        std::cerr << "Failed to read conversation." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to read conversation.");
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    std::vector<std::string> lines;
+    SQLINTEGER senderId;
+    SQLCHAR message[1000], sendDate[50];
+    SQLLEN messageLen, sendDateLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &senderId, sizeof(senderId), NULL);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, message, sizeof(message), &messageLen);
+        SQLGetData(hstmt, 3, SQL_C_CHAR, sendDate, sizeof(sendDate), &sendDateLen);
+        lines.push_back(std::string((char*)sendDate) + " " + (senderId == userId ? first_name : conversation.peerName) + ": " + (char*)message);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    // A short live history may continue in the archive, which only holds
+    // messages older than anything still in the table.
+    std::vector<ArchivedMessage> archived;
+    if (lines.size() < static_cast<size_t>(conversationMessages) &&
+        RetentionManager::instance().readArchived({ userId, peerId }, archived)) {
+        std::sort(archived.begin(), archived.end(),
+            [](const ArchivedMessage& a, const ArchivedMessage& b) { return a.sendDate > b.sendDate; });
+        for (const ArchivedMessage& message : archived) {
+            bool inConversation = (message.senderId == userId && message.receiverId == peerId) ||
+                (message.senderId == peerId && message.receiverId == userId);
+            if (!inConversation) {
+                continue;
+            }
+            if (lines.size() >= static_cast<size_t>(conversationMessages)) {
+                break;
+            }
+            lines.push_back(message.sendDate + " " + (message.senderId == userId ? first_name : conversation.peerName) + ": " + message.messageText);
+        }
+    }
+
+    std::cout << "Conversation with " << conversation.peerName << ":" << std::endl;
+    for (auto line = lines.rbegin(); line != lines.rend(); ++line) {
+        std::cout << *line << std::endl;
+    }
+
+    std::string queryMarkRead = "UPDATE inbox SET unread_count = 0 WHERE user_id = ? AND peer_id = ?";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryMarkRead.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &userId, 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &peerId, 0, NULL);
+    ret = SQLExecute(hstmt);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    if (succeeded(ret)) {
+        dbManager.recordWrite();
+    }
+    dbManager.disconnectFromDatabase();
+
+    if (!succeeded(ret)) {
+        logger.Log<LogLevel::Error>("Failed to mark conversation as read.");
+        return false;
+    }
+    logger.Log<LogLevel::Debug>("Conversation opened.", logField("user_id", userId), logField("peer_id", peerId));
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <windows.h>
+#include <sqlext.h>
+#include <string>
+#include <vector>
+
+class DatabaseManager;
+
+struct Conversation {
+    SQLINTEGER userId;
+    SQLINTEGER peerId;
+    size_t shard;
+    SQLINTEGER lastMessageId;
+    SQLINTEGER unreadCount;
+    std::string peerName;
+    std::string preview;
+    std::string lastDate;
+};
+
+// One inbox row per (user, peer) with the last message, a preview and
+// an unread count. Rows live on the conversation's message shard and
+// are upserted by sendMessage in the same transaction as the message,
+// so listing conversations is a range read on (user_id, last_date) per
+// shard instead of a GROUP BY over messages.
+class InboxManager {
+public:
+    static bool recordMessage(SQLHANDLE hdbc, SQLINTEGER senderId, SQLINTEGER receiverId, SQLINTEGER messageId, const std::string& messageText);
+    // Rebuilds one server's inbox from its messages table; unread counts
+    // start at zero. With onlyIfEmpty, an inbox that already has rows is
+    // left alone, which makes it the one-time backfill for older data.
+    static bool rebuild(DatabaseManager& dbManager, bool onlyIfEmpty);
+
+    bool listConversations(const std::string& first_name, std::vector<Conversation>& conversations);
+    bool openConversation(const std::string& first_name, const Conversation& conversation);
+};
@@ -0,0 +1,441 @@
+// Load generator for the chat: N concurrent sessions run the chatMenu /
+// chatRoom operations against the configured database (point
+// --config at a chatdb.cfg whose primary= is a local stand-in DSN).
+// Arrivals are open-loop: operations are scheduled at a fixed rate
+// regardless of how fast the previous ones finished, and latency is
+// measured from the scheduled time, so queueing under overload shows up
+// in the percentiles instead of silently lowering the request rate.
+//
+//   loadtest --sessions 200 --rate 500 --duration 60
+//            [--mix send=50,read=30,login=10,readlog=5,register=4,delete=1]
+//            [--trace log.txt [--speedup 100]] [--config loadtest.cfg]
+//            [--interval 5]
+#include "chat.h"
+#include "config.h"
+#include "logger.h"
+#include "users.h"
+#include "message.h"
+#include "purger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern MessageManager messageManager;
+
+using Clock = std::chrono::steady_clock;
+
+enum Operation { OpRegister, OpLogin, OpSend, OpRead, OpReadLog, OpDelete, OpCount };
+
+static const char* operationNames[OpCount] = { "register", "login", "send", "read", "readlog", "delete" };
+
+struct Arrival {
+    Operation op;
+    Clock::time_point scheduled;
+};
+
+struct LoadOptions {
+    int sessions = 50;
+    double rate = 100.0;
+    int durationSeconds = 30;
+    int intervalSeconds = 5;
+    double speedup = 0.0;
+    std::string mix = "send=50,read=30,login=10,readlog=5,register=4,delete=1";
+    std::string tracePath;
+    std::string configPath;
+};
+
+// Latencies and errors for one reporting interval, per operation.
+struct IntervalStats {
+    std::vector<double> latencies[OpCount];
+    int errors[OpCount] = {};
+};
+
+// Swallows everything written to it; std::cout is pointed here while
+// the managers run so their output stays out of the report.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return traits_type::not_eof(c);
+    }
+};
+
+static std::mutex statsMutex;
+static IntervalStats currentInterval;
+static IntervalStats totals;
+
+static void record(Operation op, double latencyMs, bool ok) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    currentInterval.latencies[op].push_back(latencyMs);
+    totals.latencies[op].push_back(latencyMs);
+    if (!ok) {
+        ++currentInterval.errors[op];
+        ++totals.errors[op];
+    }
+}
+
+static double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void printStats(std::ostream& out, const std::string& label, IntervalStats& stats, double seconds) {
+    out << "== " << label << " ==" << std::endl;
+    out << std::left << std::setw(10) << "op" << std::right << std::setw(10) << "ops/s" << std::setw(10) << "p50 ms"
+        << std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::setw(10) << "errors" << std::endl;
+    for (int op = 0; op < OpCount; ++op) {
+        std::vector<double>& values = stats.latencies[op];
+        if (values.empty()) {
+            continue;
+        }
+        double maximum = *std::max_element(values.begin(), values.end());
+        out << std::left << std::setw(10) << operationNames[op] << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << values.size() / seconds
+            << std::setw(10) << percentile(values, 0.50)
+            << std::setw(10) << percentile(values, 0.95)
+            << std::setw(10) << percentile(values, 0.99)
+            << std::setw(10) << maximum
+            << std::setw(9) << (100.0 * stats.errors[op] / values.size()) << "%" << std::endl;
+    }
+}
+
+static bool parseMix(const std::string& mix, std::vector<double>& weights) {
+    weights.assign(OpCount, 0.0);
+    std::stringstream stream(mix);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t separator = item.find('=');
+        if (separator == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, separator);
+        auto found = std::find_if(std::begin(operationNames), std::end(operationNames),
+            [&](const char* candidate) { return name == candidate; });
+        if (found == std::end(operationNames)) {
+            return false;
+        }
+        weights[found - std::begin(operationNames)] = std::stod(item.substr(separator + 1));
+    }
+    return true;
+}
+
+struct TraceEvent {
+    Operation op;
+    time_t timestamp;
+};
+
+// Rebuilds the user actions from the records chat.cpp writes after each
+// one: "[time] [LEVEL] message". Only a record whose message is exactly
+// the marker counts, so MessageManager's "Message sent. sender_id=..."
+// record is not mistaken for the chat room's "Message sent.".
+static std::vector<TraceEvent> loadTrace(const std::string& path) {
+    static const std::pair<const char*, Operation> markers[] = {
+        { "Registration successful", OpRegister },
+        { "Login successful. Welcome", OpLogin },
+        { "Message sent.", OpSend },
+        { "Chat history for user", OpRead },
+        { "User and related messages deleted successfully.", OpDelete },
+    };
+
+    std::vector<TraceEvent> events;
+    std::ifstream traceFile(path);
+    std::string line;
+    while (std::getline(traceFile, line)) {
+        if (line.size() < 22 || line[0] != '[') {
+            continue;
+        }
+        std::tm parsed = {};
+        std::istringstream timeStream(line.substr(1, 19));
+        timeStream >> std::get_time(&parsed, "%Y-%m-%d %H:%M:%S");
+        if (timeStream.fail()) {
+            continue;
+        }
+        std::string message = line.substr(22);
+        LogLevel level;
+        size_t levelEnd = message.find("] ");
+        if (!message.empty() && message[0] == '[' && levelEnd != std::string::npos &&
+            parseLogLevel(message.substr(1, levelEnd - 1), level)) {
+            message = message.substr(levelEnd + 2);
+        }
+        for (const auto& marker : markers) {
+            if (message == marker.first) {
+                events.push_back({ marker.second, std::mktime(&parsed) });
+                break;
+            }
+        }
+    }
+    return events;
+}
+
+class LoadGenerator {
+public:
+    LoadGenerator(const LoadOptions& options)
+        : options(options), stopping(false), nextUser(0), runId(std::to_string(std::time(nullptr))) {}
+
+    bool prepareUsers() {
+        UserManager userManager;
+        for (int i = 0; i < options.sessions; ++i) {
+            std::string name = "load" + std::to_string(i + 1);
+            if (!userManager.loginPass(name, "pass") &&
+                !userManager.registerUser(name, "Load", name + "@loadtest.local")) {
+                return false;
+            }
+            sessionUsers.push_back(name);
+        }
+        return true;
+    }
+
+    void run(const std::vector<Operation>& schedule, const std::vector<double>& gapsMs, std::ostream& report) {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < options.sessions; ++i) {
+            workers.emplace_back([this, i]() { sessionLoop(i); });
+        }
+        std::thread reporter([this, &report]() { reportLoop(report); });
+
+        Clock::time_point start = Clock::now();
+        Clock::time_point end = start + std::chrono::seconds(options.durationSeconds);
+        Clock::time_point next = start;
+        for (size_t i = 0; next < end; ++i) {
+            std::this_thread::sleep_until(next);
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                arrivals.push_back({ schedule[i % schedule.size()], next });
+            }
+            queueReady.notify_one();
+            next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(gapsMs[i % gapsMs.size()]));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        reporter.join();
+
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(statsMutex);
+        printStats(report, "total", totals, seconds);
+    }
+
+private:
+    void sessionLoop(int session) {
+        std::mt19937 random(static_cast<unsigned>(session) * 7919u + 17u);
+        UserManager userManager;
+        ChatManager chatManager;
+        const std::string& user = sessionUsers[session];
+
+        while (true) {
+            Arrival arrival;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueReady.wait(lock, [this]() { return stopping || !arrivals.empty(); });
+                if (arrivals.empty()) {
+                    return;
+                }
+                arrival = arrivals.front();
+                arrivals.pop_front();
+            }
+
+            bool ok = true;
+            switch (arrival.op) {
+            case OpRegister: {
+                // Names and emails are unique per run, so users left
+                // behind by earlier runs do not turn registers into errors.
+                std::string name = "loadreg" + runId + "_" + std::to_string(++nextUser);
+                ok = userManager.registerUser(name, "Load", name + "@loadtest.local");
+                if (ok) {
+                    std::lock_guard<std::mutex> lock(registeredMutex);
+                    registeredUsers.push_back(name);
+                }
+                break;
+            }
+            case OpLogin:
+                ok = userManager.loginPass(user, "pass");
+                break;
+            case OpSend: {
+                const std::string& receiver = sessionUsers[random() % sessionUsers.size()];
+                ok = messageManager.sendMessage(user, receiver, "load test message");
+                break;
+            }
+            case OpRead:
+                ok = chatManager.displayUserChat(user);
+                break;
+            case OpReadLog:
+                logger.ReadLastLines(10);
+                logger.ReadLog();
+                break;
+            case OpDelete: {
+                std::string name;
+                {
+                    std::lock_guard<std::mutex> lock(registeredMutex);
+                    if (!registeredUsers.empty()) {
+                        name = registeredUsers.back();
+                        registeredUsers.pop_back();
+                    }
+                }
+                if (name.empty()) {
+                    continue;
+                }
+                ok = userManager.deleteUserAndMessages(name);
+                break;
+            }
+            default:
+                break;
+            }
+
+            double latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - arrival.scheduled).count();
+            record(arrival.op, latencyMs, ok);
+        }
+    }
+
+    void reportLoop(std::ostream& report) {
+        int elapsed = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                if (queueReady.wait_for(lock, std::chrono::seconds(options.intervalSeconds), [this]() { return stopping && arrivals.empty(); })) {
+                    return;
+                }
+            }
+            elapsed += options.intervalSeconds;
+
+            IntervalStats interval;
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                std::swap(interval, currentInterval);
+            }
+            size_t backlog;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                backlog = arrivals.size();
+            }
+            printStats(report, "t=" + std::to_string(elapsed) + "s backlog=" + std::to_string(backlog), interval, options.intervalSeconds);
+        }
+    }
+
+    LoadOptions options;
+    std::vector<std::string> sessionUsers;
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<Arrival> arrivals;
+    bool stopping;
+    std::atomic<int> nextUser;
+    std::string runId;
+    std::mutex registeredMutex;
+    std::vector<std::string> registeredUsers;
+};
+
+static bool parseOptions(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--sessions") options.sessions = std::stoi(value);
+        else if (arg == "--rate") options.rate = std::stod(value);
+        else if (arg == "--duration") options.durationSeconds = std::stoi(value);
+        else if (arg == "--interval") options.intervalSeconds = std::stoi(value);
+        else if (arg == "--mix") options.mix = value;
+        else if (arg == "--trace") options.tracePath = value;
+        else if (arg == "--speedup") options.speedup = std::stod(value);
+        else if (arg == "--config") options.configPath = value;
+        else return false;
+    }
+    return options.sessions > 0 && options.rate > 0 && options.durationSeconds > 0 && options.intervalSeconds > 0;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: loadtest [--sessions N] [--rate ops/s] [--duration s] [--interval s] "
+            "[--mix op=weight,...] [--trace log.txt [--speedup x]] [--config file]" << std::endl;
+        return 1;
+    }
+    if (!options.configPath.empty() && !config.load(options.configPath)) {
+        std::cerr << "Failed to read config '" << options.configPath << "'." << std::endl;
+        return 1;
+    }
+    logger.SetLevel(LogLevel::Warn);
+
+    // Build the operation sequence and the gaps between arrivals: either
+    // the recorded trace (its own timing scaled by --speedup, or Poisson
+    // at --rate) or a weighted random mix at --rate.
+    std::mt19937 random(12345);
+    std::exponential_distribution<double> poisson(options.rate / 1000.0);
+    std::vector<Operation> schedule;
+    std::vector<double> gapsMs;
+    if (!options.tracePath.empty()) {
+        std::vector<TraceEvent> events = loadTrace(options.tracePath);
+        if (events.empty()) {
+            std::cerr << "No user actions found in '" << options.tracePath << "'." << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < events.size(); ++i) {
+            schedule.push_back(events[i].op);
+            if (options.speedup > 0) {
+                time_t next = events[(i + 1) % events.size()].timestamp;
+                double gap = next > events[i].timestamp ? std::difftime(next, events[i].timestamp) * 1000.0 : 0.0;
+                gapsMs.push_back(gap / options.speedup);
+            }
+            else {
+                gapsMs.push_back(poisson(random));
+            }
+        }
+    }
+    else {
+        std::vector<double> weights;
+        if (!parseMix(options.mix, weights)) {
+            std::cerr << "Invalid --mix '" << options.mix << "'." << std::endl;
+            return 1;
+        }
+        std::discrete_distribution<int> pick(weights.begin(), weights.end());
+        size_t planned = static_cast<size_t>(options.rate * options.durationSeconds) + 1;
+        for (size_t i = 0; i < planned; ++i) {
+            schedule.push_back(static_cast<Operation>(pick(random)));
+            gapsMs.push_back(poisson(random));
+        }
+    }
+
+    // The managers print every step to std::cout; keep the report readable.
+    std::ostream report(std::cout.rdbuf());
+    NullBuffer discard;
+    std::streambuf* original = std::cout.rdbuf(&discard);
+
+    LoadGenerator generator(options);
+    if (!generator.prepareUsers()) {
+        std::cout.rdbuf(original);
+        std::cerr << "Failed to prepare session users." << std::endl;
+        return 1;
+    }
+    report << "Running " << options.sessions << " sessions at " << options.rate << " ops/s for "
+        << options.durationSeconds << " s" << std::endl;
+    // Deletes only tombstone users; purge them under the same load.
+    UserPurger::instance().start();
+    generator.run(schedule, gapsMs, report);
+    UserPurger::instance().stop();
+
+    std::cout.rdbuf(original);
+    return 0;
+}
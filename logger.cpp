@@ -1,11 +1,13 @@
 #include "logger.h"
+#include "trace.h"
 #include <iostream>
 #include <ctime>
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <cctype>
 
-Logger::Logger(const std::string& logFilePath) : logFilePath(logFilePath) {
+Logger::Logger(const std::string& logFilePath) : logFilePath(logFilePath), minLevel(LogLevel::Info) {
     logFile.open(logFilePath, std::ios::out | std::ios::app);
 
     if (!logFile.is_open()) {
@@ -19,7 +21,26 @@ Logger::~Logger() {
     }
 }
 
+bool parseLogLevel(const std::string& name, LogLevel& level) {
+    const LogLevel levels[] = { LogLevel::Trace, LogLevel::Debug, LogLevel::Info, LogLevel::Warn, LogLevel::Error };
+    std::string upper = name;
+    std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+
+    for (LogLevel candidate : levels) {
+        if (upper == logLevelName(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::SetLevel(LogLevel level) {
+    minLevel.store(level, std::memory_order_relaxed);
+}
+
 void Logger::WriteLog(const std::string& logMessage) {
+    TraceSpan span("logger.write");
     std::lock_guard<std::mutex> lock(fileMutex);
 
     if (logFile.is_open()) {
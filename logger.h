@@ -2,21 +2,91 @@
 #include <string>
 #include <fstream>
 #include <mutex>
+#include <atomic>
+#include <sstream>
+#include <utility>
+
+enum class LogLevel { Trace = 0, Debug = 1, Info = 2, Warn = 3, Error = 4 };
+
+// Records below this level are removed at compile time. Release builds
+// default to Info; override with /DCHATLOGGER_MIN_LOG_LEVEL=<0..4>.
+#ifndef CHATLOGGER_MIN_LOG_LEVEL
+#ifdef NDEBUG
+#define CHATLOGGER_MIN_LOG_LEVEL 2
+#else
+#define CHATLOGGER_MIN_LOG_LEVEL 0
+#endif
+#endif
+
+constexpr LogLevel compiledLogLevel = static_cast<LogLevel>(CHATLOGGER_MIN_LOG_LEVEL);
+
+constexpr const char* logLevelName(LogLevel level) {
+    return level == LogLevel::Trace ? "TRACE" :
+        level == LogLevel::Debug ? "DEBUG" :
+        level == LogLevel::Info ? "INFO" :
+        level == LogLevel::Warn ? "WARN" : "ERROR";
+}
+
+bool parseLogLevel(const std::string& name, LogLevel& level);
+
+// A key/value attached to a record. Lvalues are held by reference and
+// only temporaries are moved in, so building a field copies nothing; the
+// value is formatted only when the record is written. Fields are meant
+// to be built in the Log<>() call itself, which outlives them.
+template <typename T>
+struct LogField {
+    const char* key;
+    T value;
+};
+
+template <typename T>
+LogField<T> logField(const char* key, T&& value) {
+    return LogField<T>{ key, std::forward<T>(value) };
+}
 
 class Logger {
 public:
     Logger(const std::string& logFilePath);
     ~Logger();
 
-    void WriteLog(const std::string& logMessage);
     std::string ReadLog();
 
      std::string ReadLastLines(int numLines);
 
+    template <LogLevel Level, typename... Fields>
+    void Log(const char* message, const Fields&... fields) {
+        if constexpr (Level >= compiledLogLevel) {
+            if (IsEnabled(Level)) {
+                std::ostringstream record;
+                record << "[" << logLevelName(Level) << "] " << message;
+                ((record << " " << fields.key << "=" << fields.value), ...);
+                WriteLog(record.str());
+            }
+        }
+    }
+
+    bool IsEnabled(LogLevel level) const {
+        return level >= minLevel.load(std::memory_order_relaxed);
+    }
+    // False at compile time when Level is compiled out, so work done
+    // only for a record of that level can be skipped along with it.
+    template <LogLevel Level>
+    bool Enabled() const {
+        if constexpr (Level >= compiledLogLevel) {
+            return IsEnabled(Level);
+        }
+        return false;
+    }
+    void SetLevel(LogLevel level);
+
 private:
+    // Every record goes through Log<>, so each one carries a level.
+    void WriteLog(const std::string& logMessage);
+
     std::string logFilePath;
     std::fstream logFile;
     std::mutex fileMutex;
+    std::atomic<LogLevel> minLevel;
 };
 
 extern Logger logger;
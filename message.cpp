@@ -1,6 +1,10 @@
 #include "message.h"
 #include "database.h"
 #include "logger.h"
+#include "shards.h"
+#include "notify.h"
+#include "inbox.h"
+#include "trace.h"
 
 extern SQLRETURN ret;
 extern SQLHANDLE henv;
@@ -20,10 +24,11 @@ MessageManager::~MessageManager() {
 }
 
 bool MessageManager::sendMessage(const std::string& senderFirstName, const std::string& receiverFirstName, const std::string& messageText) {
+    TraceSpan span("message.sendMessage");
     DatabaseManager dbManager;
-    if (!dbManager.connectToDatabase()) {
+    if (!dbManager.connectToDatabase(AccessMode::Write, senderFirstName)) {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
         return false;
     }
 
@@ -31,11 +36,11 @@ bool MessageManager::sendMessage(const std::string& senderFirstName, const std::
     SQLHANDLE hstmt;
     SQLHANDLE hdbc = dbManager.getHDBC();
 
-    std::string queryGetSenderID = "SELECT user_id FROM users WHERE first_name = ?";
+    std::string queryGetSenderID = "SELECT user_id FROM users WHERE first_name = ? AND deleted_at IS NULL";
     ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
-    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryGetSenderID.c_str(), SQL_NTS);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryGetSenderID.c_str(), SQL_NTS); });
     ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)senderFirstName.c_str(), 0, NULL);
-    ret = SQLExecute(hstmt);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
 
     SQLINTEGER senderID;
     ret = SQLBindCol(hstmt, 1, SQL_C_SLONG, &senderID, sizeof(senderID), NULL);
@@ -43,17 +48,17 @@ bool MessageManager::sendMessage(const std::string& senderFirstName, const std::
     ret = SQLFetch(hstmt);
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::cerr << "Failed to retrieve sender ID." << std::endl;
-        logger.WriteLog("Failed to retrieve sender ID.");
+        logger.Log<LogLevel::Error>("Failed to retrieve sender ID.");
         SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
         return false;
     }
 
-    std::string queryGetReceiverID = "SELECT user_id FROM users WHERE first_name = ?";
+    std::string queryGetReceiverID = "SELECT user_id FROM users WHERE first_name = ? AND deleted_at IS NULL";
     ret = SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
     ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
-    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryGetReceiverID.c_str(), SQL_NTS);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryGetReceiverID.c_str(), SQL_NTS); });
     ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)receiverFirstName.c_str(), 0, NULL);
-    ret = SQLExecute(hstmt);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
 
     SQLINTEGER receiverID;
     ret = SQLBindCol(hstmt, 1, SQL_C_SLONG, &receiverID, sizeof(receiverID), NULL);
@@ -61,31 +66,69 @@ bool MessageManager::sendMessage(const std::string& senderFirstName, const std::
     ret = SQLFetch(hstmt);
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::cerr << "Failed to retrieve receiver ID." << std::endl;
-        logger.WriteLog("Failed to retrieve receiver ID.");
+        logger.Log<LogLevel::Error>("Failed to retrieve receiver ID.");
         SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
         return false;
     }
 
-    std::string queryInsertMessage = "INSERT INTO messages(sender_id, receiver_id, message_text, send_date) VALUES (?, ?, ?, CURRENT_TIMESTAMP)";
     ret = SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    MessageShards& shards = MessageShards::instance();
+    size_t shard = shards.shardFor(dbManager.getHDBC(), senderID, receiverID);
+    DatabaseManager shardManager;
+    DatabaseManager& target = shards.isPrimary(shard) ? dbManager : shardManager;
+    if (!shards.isPrimary(shard) && !shards.connect(shardManager, shard)) {
+        std::cerr << "Failed to connect to message shard." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to message shard.");
+        return false;
+    }
+    shards.prepareInsert(target, shard);
+    hdbc = target.getHDBC();
+
+    // The message and both inbox rows commit together.
+    SQLSetConnectAttr(hdbc, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_OFF, 0);
+
+    std::string queryInsertMessage = "INSERT INTO messages(sender_id, receiver_id, message_text, send_date) VALUES (?, ?, ?, CURRENT_TIMESTAMP)";
     ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
-    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryInsertMessage.c_str(), SQL_NTS);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryInsertMessage.c_str(), SQL_NTS); });
     ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &senderID, 0, NULL);
     ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &receiverID, 0, NULL);
     ret = SQLBindParameter(hstmt, 3, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 1000, 0, (SQLCHAR*)messageText.c_str(), 0, NULL);
-    ret = SQLExecute(hstmt);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    bool sent = ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO;
 
-    if (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) {
-        std::cout << "Message sent." << std::endl;
-        logger.WriteLog("Message sent.");
+    SQLINTEGER messageID = 0;
+    if (sent) {
+        std::string queryLastInsertID = "SELECT LAST_INSERT_ID()";
+        ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+        ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryLastInsertID.c_str(), SQL_NTS);
+        ret = SQLBindCol(hstmt, 1, SQL_C_SLONG, &messageID, sizeof(messageID), NULL);
+        ret = SQLFetch(hstmt);
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        sent = (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) &&
+            InboxManager::recordMessage(hdbc, senderID, receiverID, messageID, messageText);
     }
-    else {
+
+    SQLEndTran(SQL_HANDLE_DBC, hdbc, sent ? SQL_COMMIT : SQL_ROLLBACK);
+    SQLSetConnectAttr(hdbc, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_ON, 0);
+
+    if (!sent) {
         std::cerr << "Failed to send message." << std::endl;
-        logger.WriteLog("Failed to send message.");
-        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        logger.Log<LogLevel::Error>("Failed to send message.");
+        if (!shards.isPrimary(shard)) {
+            shardManager.disconnectFromDatabase();
+        }
         return false;
     }
 
-    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    dbManager.recordWrite();
+    std::cout << "Message sent." << std::endl;
+    logger.Log<LogLevel::Info>("Message sent.", logField("sender_id", senderID), logField("receiver_id", receiverID), logField("shard", shard));
+    NotificationHub::instance().publish({ receiverID, senderID, messageID, shard });
+
+    if (!shards.isPrimary(shard)) {
+        shardManager.disconnectFromDatabase();
+    }
     return true;
 }
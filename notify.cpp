@@ -0,0 +1,77 @@
+#include "notify.h"
+
+bool NotificationHub::Subscription::wait(std::vector<MessageNotification>& notifications, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    queueReady.wait_for(lock, timeout, [this]() { return cancelled || !pending.empty(); });
+    notifications.assign(pending.begin(), pending.end());
+    pending.clear();
+    return !cancelled;
+}
+
+void NotificationHub::Subscription::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        cancelled = true;
+    }
+    queueReady.notify_all();
+}
+
+void NotificationHub::Subscription::push(const MessageNotification& notification) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.push_back(notification);
+    }
+    queueReady.notify_one();
+}
+
+NotificationHub& NotificationHub::instance() {
+    static NotificationHub hub;
+    return hub;
+}
+
+std::shared_ptr<NotificationHub::Subscription> NotificationHub::subscribe(const std::vector<int>& userIds) {
+    std::shared_ptr<Subscription> subscription = std::make_shared<Subscription>();
+
+    std::lock_guard<std::mutex> lock(hubMutex);
+    for (int userId : userIds) {
+        subscriptions.emplace(userId, subscription);
+    }
+    return subscription;
+}
+
+void NotificationHub::unsubscribe(const std::shared_ptr<Subscription>& subscription) {
+    std::lock_guard<std::mutex> lock(hubMutex);
+
+    for (auto it = subscriptions.begin(); it != subscriptions.end();) {
+        std::shared_ptr<Subscription> current = it->second.lock();
+        if (!current || current == subscription) {
+            it = subscriptions.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void NotificationHub::publish(const MessageNotification& notification) {
+    std::vector<std::shared_ptr<Subscription>> targets;
+    {
+        std::lock_guard<std::mutex> lock(hubMutex);
+        auto range = subscriptions.equal_range(notification.receiverId);
+        for (auto it = range.first; it != range.second;) {
+            std::shared_ptr<Subscription> subscription = it->second.lock();
+            if (subscription) {
+                targets.push_back(subscription);
+                ++it;
+            }
+            else {
+                it = subscriptions.erase(it);
+            }
+        }
+    }
+
+    for (const std::shared_ptr<Subscription>& subscription : targets) {
+        subscription->push(notification);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// shard is where the sender stored the message, so watchers read it
+// from there without looking the placement up again.
+struct MessageNotification {
+    int receiverId;
+    int senderId;
+    int messageId;
+    size_t shard;
+};
+
+// In-process pub/sub for new messages. sendMessage publishes after the
+// insert; sessions subscribe per receiver id and are woken through a
+// condition variable, then fetch just the announced rows. Only sessions
+// of the same process are notified; messages sent by another client
+// process are not announced here.
+class NotificationHub {
+public:
+    class Subscription {
+    public:
+        // Blocks until a notification arrives, cancel() is called or the
+        // timeout expires; returns false once cancelled.
+        bool wait(std::vector<MessageNotification>& notifications, std::chrono::milliseconds timeout);
+        void cancel();
+
+    private:
+        friend class NotificationHub;
+        void push(const MessageNotification& notification);
+
+        std::mutex queueMutex;
+        std::condition_variable queueReady;
+        std::deque<MessageNotification> pending;
+        bool cancelled = false;
+    };
+
+    static NotificationHub& instance();
+
+    std::shared_ptr<Subscription> subscribe(const std::vector<int>& userIds);
+    void unsubscribe(const std::shared_ptr<Subscription>& subscription);
+    void publish(const MessageNotification& notification);
+
+private:
+    std::mutex hubMutex;
+    std::multimap<int, std::weak_ptr<Subscription>> subscriptions;
+};
@@ -0,0 +1,186 @@
+#include "purger.h"
+#include "config.h"
+#include "logger.h"
+#include "retention.h"
+#include "shards.h"
+#include <vector>
+
+UserPurger& UserPurger::instance() {
+    static UserPurger purger;
+    return purger;
+}
+
+UserPurger::UserPurger() : running(false), woken(false) {
+    chunkRows = config.getInt("purge_chunk_rows", 1000);
+    pauseMs = config.getInt("purge_pause_ms", 50);
+    intervalSeconds = config.getInt("purge_interval_seconds", 60);
+}
+
+void UserPurger::start() {
+    if (purger.joinable()) {
+        return;
+    }
+    running = true;
+    purger = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        while (running) {
+            woken = false;
+            lock.unlock();
+            runOnce();
+            lock.lock();
+            wakeUp.wait_for(lock, std::chrono::seconds(intervalSeconds), [this]() { return !running || woken; });
+        }
+    });
+}
+
+void UserPurger::stop() {
+    if (!purger.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        running = false;
+    }
+    wakeUp.notify_all();
+    purger.join();
+}
+
+void UserPurger::wake() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        woken = true;
+    }
+    wakeUp.notify_all();
+}
+
+// Sleeps between chunks; returns false once stop() has been called.
+bool UserPurger::pause() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    wakeUp.wait_for(lock, std::chrono::milliseconds(pauseMs), [this]() { return !running; });
+    return running;
+}
+
+bool UserPurger::runOnce() {
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase(AccessMode::Write)) {
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    std::string queryTombstones = "SELECT user_id, first_name FROM users WHERE deleted_at IS NOT NULL ORDER BY deleted_at";
+    std::vector<std::pair<SQLINTEGER, std::string>> tombstones;
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLExecDirectA(hstmt, (SQLCHAR*)queryTombstones.c_str(), SQL_NTS);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        dbManager.disconnectFromDatabase();
+        return false;
+    }
+    SQLINTEGER userId;
+    SQLCHAR firstName[51];
+    SQLLEN firstNameLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_SLONG, &userId, sizeof(userId), NULL);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, firstName, sizeof(firstName), &firstNameLen);
+        tombstones.push_back({ userId, (char*)firstName });
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+
+    bool ok = true;
+    for (const auto& tombstone : tombstones) {
+        if (!running || !purgeUser(dbManager, tombstone.first, tombstone.second)) {
+            ok = false;
+            break;
+        }
+    }
+    dbManager.disconnectFromDatabase();
+    return ok;
+}
+
+bool UserPurger::purgeUser(DatabaseManager& dbManager, SQLINTEGER userId, const std::string& firstName) {
+    logger.Log<LogLevel::Info>("Purging deleted user.", logField("user", firstName), logField("user_id", userId));
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    size_t channelRows = 0;
+
+    if (!dbManager.executeStatement("DELETE FROM channel_members WHERE user_id = " + std::to_string(userId)) ||
+        !deleteInChunks(hdbc, "DELETE FROM channel_messages WHERE sender_id = ? LIMIT ", userId, channelRows)) {
+        logger.Log<LogLevel::Error>("Failed to purge channel data.", logField("user_id", userId));
+        return false;
+    }
+
+    MessageShards& shards = MessageShards::instance();
+    std::vector<size_t> shardRows(shards.count(), 0);
+    std::vector<size_t> inboxRows(shards.count(), 0);
+    bool purged = shards.forEachShard([&](size_t shard, SQLHANDLE shardHdbc) {
+        return deleteInChunks(shardHdbc, "DELETE FROM messages WHERE sender_id = ? LIMIT ", userId, shardRows[shard]) &&
+            deleteInChunks(shardHdbc, "DELETE FROM messages WHERE receiver_id = ? LIMIT ", userId, shardRows[shard]) &&
+            deleteInChunks(shardHdbc, "DELETE FROM inbox WHERE user_id = ? LIMIT ", userId, inboxRows[shard]) &&
+            deleteInChunks(shardHdbc, "DELETE FROM inbox WHERE peer_id = ? LIMIT ", userId, inboxRows[shard]);
+    }, AccessMode::Write, "", &dbManager);
+
+    size_t messageRows = 0;
+    for (size_t rows : shardRows) {
+        messageRows += rows;
+    }
+    if (!purged) {
+        logger.Log<LogLevel::Warn>("User purge interrupted.", logField("user_id", userId), logField("messages_deleted", messageRows));
+        return false;
+    }
+
+    // The users row is the tombstone; keep it until the archive is clean
+    // too, so a failed rewrite is retried on the next pass.
+    size_t archivedRows = 0;
+    if (!RetentionManager::instance().purgeArchived(userId, archivedRows)) {
+        logger.Log<LogLevel::Warn>("Failed to purge archived messages.", logField("user_id", userId));
+        return false;
+    }
+
+    // Nothing references the user any more, so this is a small
+    // transaction; the trigger only removes the password.
+    if (!dbManager.executeStatement("DELETE FROM users WHERE user_id = " + std::to_string(userId) + " AND deleted_at IS NOT NULL")) {
+        logger.Log<LogLevel::Error>("Failed to delete purged user.", logField("user_id", userId));
+        return false;
+    }
+    logger.Log<LogLevel::Info>("Deleted user purged.", logField("user", firstName), logField("user_id", userId),
+        logField("messages_deleted", messageRows), logField("archived_deleted", archivedRows),
+        logField("channel_messages_deleted", channelRows));
+    return true;
+}
+
+// Each chunk is its own autocommit statement, so locks are held for at
+// most chunkRows rows at a time.
+bool UserPurger::deleteInChunks(SQLHANDLE hdbc, const std::string& query, SQLINTEGER userId, size_t& deleted) {
+    std::string queryChunk = query + std::to_string(chunkRows);
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryChunk.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &userId, 0, NULL);
+
+    size_t chunks = 0;
+    SQLLEN rows = chunkRows;
+    while (rows >= chunkRows) {
+        ret = SQLExecute(hstmt);
+        if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO && ret != SQL_NO_DATA) {
+            SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+            return false;
+        }
+        rows = 0;
+        SQLRowCount(hstmt, &rows);
+        SQLFreeStmt(hstmt, SQL_CLOSE);
+        deleted += static_cast<size_t>(rows > 0 ? rows : 0);
+
+        if (++chunks % 100 == 0) {
+            logger.Log<LogLevel::Info>("Purge progress.", logField("user_id", userId), logField("rows_deleted", deleted));
+        }
+        if (rows >= chunkRows && !pause()) {
+            SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+            return false;
+        }
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "database.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Removes tombstoned users (users.deleted_at set) in the background.
+// Messages and inbox rows go first, shard by shard, in DELETE ... LIMIT chunks of
+// purge_chunk_rows with a purge_pause_ms pause in between, so no single
+// transaction holds locks on messages for long. The users row itself is
+// deleted last, which also drops the password through delete_user_trigger.
+// Before that the user's rows are also cut out of the message archive.
+class UserPurger {
+public:
+    static UserPurger& instance();
+
+    void start();
+    void stop();
+    // Starts a purge pass now instead of at the next interval.
+    void wake();
+
+private:
+    UserPurger();
+
+    bool runOnce();
+    bool purgeUser(DatabaseManager& dbManager, SQLINTEGER userId, const std::string& firstName);
+    bool deleteInChunks(SQLHANDLE hdbc, const std::string& query, SQLINTEGER userId, size_t& deleted);
+    bool pause();
+
+    int chunkRows;
+    int pauseMs;
+    int intervalSeconds;
+
+    std::thread purger;
+    std::mutex stateMutex;
+    std::condition_variable wakeUp;
+    std::atomic<bool> running;
+    bool woken;
+};
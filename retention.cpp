@@ -0,0 +1,460 @@
+#include "retention.h"
+#include "config.h"
+#include "logger.h"
+#include "shards.h"
+#include "snapshot.h"
+#include <cstdio>
+#include <filesystem>
+
+static const int futureMonths = 2;
+
+static bool succeeded(SQLRETURN ret) {
+    return ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO;
+}
+
+static std::string partitionName(int year, int month) {
+    char name[16];
+    snprintf(name, sizeof(name), "p%04d%02d", year, month);
+    return name;
+}
+
+// "PARTITION p202401 VALUES LESS THAN (UNIX_TIMESTAMP('2024-02-01'))"
+static std::string partitionClause(int year, int month) {
+    int nextYear = month == 12 ? year + 1 : year;
+    int nextMonth = month == 12 ? 1 : month + 1;
+    char bound[16];
+    snprintf(bound, sizeof(bound), "%04d-%02d-01", nextYear, nextMonth);
+    return "PARTITION " + partitionName(year, month) + " VALUES LESS THAN (UNIX_TIMESTAMP('" + bound + "'))";
+}
+
+static bool queryInts(SQLHANDLE hdbc, const std::string& query, std::vector<SQLINTEGER>& values) {
+    SQLHANDLE hstmt;
+    SQLRETURN ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLExecDirectA(hstmt, (SQLCHAR*)query.c_str(), SQL_NTS);
+    if (!succeeded(ret) || SQLFetch(hstmt) != SQL_SUCCESS) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+        SQLGetData(hstmt, (SQLUSMALLINT)(i + 1), SQL_C_SLONG, &values[i], sizeof(values[i]), NULL);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+static bool queryStrings(SQLHANDLE hdbc, const std::string& query, std::vector<std::string>& values) {
+    SQLHANDLE hstmt;
+    SQLRETURN ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLExecDirectA(hstmt, (SQLCHAR*)query.c_str(), SQL_NTS);
+    if (!succeeded(ret)) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+    SQLCHAR value[256];
+    SQLLEN valueLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_CHAR, value, sizeof(value), &valueLen);
+        values.push_back((char*)value);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+RetentionManager& RetentionManager::instance() {
+    static RetentionManager retention;
+    return retention;
+}
+
+RetentionManager::RetentionManager() : running(false), archiveCacheBytes(0), archiveUseCount(0) {
+    retentionDays = config.getInt("retention_days", 0);
+    intervalMinutes = config.getInt("archive_interval_minutes", 60);
+    archiveDirectory = config.get("archive_dir", "archive");
+    archiveCacheLimit = static_cast<size_t>(config.getInt("archive_cache_mb", 64)) * 1024 * 1024;
+}
+
+bool RetentionManager::isEnabled() const {
+    return retentionDays > 0;
+}
+
+void RetentionManager::start() {
+    if (!isEnabled() || archiver.joinable()) {
+        return;
+    }
+    running = true;
+    archiver = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        while (running) {
+            lock.unlock();
+            runOnce();
+            lock.lock();
+            wakeUp.wait_for(lock, std::chrono::minutes(intervalMinutes), [this]() { return !running; });
+        }
+    });
+    logger.Log<LogLevel::Info>("Message archiver started.", logField("retention_days", retentionDays));
+}
+
+void RetentionManager::stop() {
+    if (!archiver.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        running = false;
+    }
+    wakeUp.notify_all();
+    archiver.join();
+}
+
+bool RetentionManager::runOnce() {
+    MessageShards& shards = MessageShards::instance();
+    bool ok = true;
+
+    for (size_t shard = 0; shard < shards.count(); ++shard) {
+        DatabaseManager dbManager;
+        if (!shards.connect(dbManager, shard)) {
+            ok = false;
+            continue;
+        }
+        ok = preparePartitions(dbManager) && ensureFuturePartitions(dbManager) && archiveExpired(dbManager, shard) && ok;
+        dbManager.disconnectFromDatabase();
+    }
+    return ok;
+}
+
+// One-time conversion of a plain messages table. Partitioned InnoDB
+// tables allow neither foreign keys nor a primary key that leaves out
+// the partitioning column, so the FKs are dropped (the purger removes a
+// deleted user's messages before the users row) and send_date joins the
+// key.
+bool RetentionManager::preparePartitions(DatabaseManager& dbManager) {
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    std::vector<SQLINTEGER> partitionCount(1, 0);
+    if (!queryInts(hdbc, "SELECT COUNT(*) FROM INFORMATION_SCHEMA.PARTITIONS "
+        "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'messages' AND PARTITION_NAME IS NOT NULL", partitionCount)) {
+        return false;
+    }
+    if (partitionCount[0] > 0) {
+        return true;
+    }
+
+    std::cout << "Partitioning 'messages' by month..." << std::endl;
+    logger.Log<LogLevel::Info>("Partitioning 'messages' by month...");
+
+    std::vector<std::string> foreignKeys;
+    queryStrings(hdbc, "SELECT CONSTRAINT_NAME FROM INFORMATION_SCHEMA.TABLE_CONSTRAINTS "
+        "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'messages' AND CONSTRAINT_TYPE = 'FOREIGN KEY'", foreignKeys);
+    for (const std::string& foreignKey : foreignKeys) {
+        if (!dbManager.executeStatement("ALTER TABLE messages DROP FOREIGN KEY " + foreignKey)) {
+            return false;
+        }
+    }
+
+    std::vector<SQLINTEGER> range(4, 0);
+    if (!queryInts(hdbc, "SELECT COALESCE(YEAR(MIN(send_date)), YEAR(NOW())), COALESCE(MONTH(MIN(send_date)), MONTH(NOW())), "
+        "YEAR(NOW()), MONTH(NOW()) FROM messages", range)) {
+        return false;
+    }
+
+    std::string partitions;
+    int year = range[0], month = range[1];
+    int lastIndex = range[2] * 12 + range[3] - 1 + futureMonths;
+    for (int index = year * 12 + month - 1; index <= lastIndex; ++index) {
+        partitions += partitionClause(index / 12, index % 12 + 1) + ", ";
+    }
+    partitions += "PARTITION pmax VALUES LESS THAN MAXVALUE";
+
+    if (!dbManager.executeStatement("ALTER TABLE messages DROP PRIMARY KEY, ADD PRIMARY KEY (message_id, send_date)") ||
+        !dbManager.executeStatement("ALTER TABLE messages PARTITION BY RANGE (UNIX_TIMESTAMP(send_date)) (" + partitions + ")")) {
+        std::cerr << "Failed to partition 'messages'." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to partition 'messages'.");
+        return false;
+    }
+    logger.Log<LogLevel::Info>("Table 'messages' partitioned.");
+    return true;
+}
+
+bool RetentionManager::ensureFuturePartitions(DatabaseManager& dbManager) {
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    std::vector<std::string> names;
+    if (!queryStrings(hdbc, "SELECT PARTITION_NAME FROM INFORMATION_SCHEMA.PARTITIONS "
+        "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'messages' AND PARTITION_NAME <> 'pmax' "
+        "ORDER BY PARTITION_ORDINAL_POSITION DESC LIMIT 1", names)) {
+        return false;
+    }
+    std::vector<SQLINTEGER> now(2, 0);
+    if (!queryInts(hdbc, "SELECT YEAR(NOW()), MONTH(NOW())", now)) {
+        return false;
+    }
+
+    int lastIndex = now[0] * 12 + now[1] - 1 + futureMonths;
+    int firstIndex = lastIndex - futureMonths;
+    if (!names.empty() && names[0].size() == 7) {
+        firstIndex = std::stoi(names[0].substr(1, 4)) * 12 + std::stoi(names[0].substr(5, 2));
+    }
+    if (firstIndex > lastIndex) {
+        return true;
+    }
+
+    std::string partitions;
+    for (int index = firstIndex; index <= lastIndex; ++index) {
+        partitions += partitionClause(index / 12, index % 12 + 1) + ", ";
+    }
+    partitions += "PARTITION pmax VALUES LESS THAN MAXVALUE";
+    return dbManager.executeStatement("ALTER TABLE messages REORGANIZE PARTITION pmax INTO (" + partitions + ")");
+}
+
+bool RetentionManager::archiveExpired(DatabaseManager& dbManager, size_t shard) {
+    SQLHANDLE hdbc = dbManager.getHDBC();
+    std::vector<std::string> expired;
+    if (!queryStrings(hdbc, "SELECT PARTITION_NAME FROM INFORMATION_SCHEMA.PARTITIONS "
+        "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'messages' AND PARTITION_DESCRIPTION <> 'MAXVALUE' "
+        "AND CAST(PARTITION_DESCRIPTION AS UNSIGNED) <= UNIX_TIMESTAMP(NOW() - INTERVAL " + std::to_string(retentionDays) + " DAY) "
+        "ORDER BY PARTITION_ORDINAL_POSITION", expired)) {
+        return false;
+    }
+
+    const SnapshotTable* messagesTable = findSnapshotTable(3);
+
+    std::lock_guard<std::mutex> writeLock(archiveWriteMutex);
+    std::error_code error;
+    std::filesystem::create_directories(archiveDirectory, error);
+
+    for (const std::string& partition : expired) {
+        std::string archivePath = archiveDirectory + "/shard" + std::to_string(shard) + "-" + partition + ".snap";
+        size_t exported = 0;
+        {
+            SnapshotWriter writer(archivePath);
+            writer.beginTable(messagesTable->id);
+            if (!writer.isOpen() || !exportSnapshotTable(hdbc, *messagesTable, writer, exported, partition) || !writer.finish()) {
+                std::cerr << "Failed to archive partition " << partition << "." << std::endl;
+                logger.Log<LogLevel::Error>("Failed to archive partition.", logField("partition", partition), logField("shard", shard));
+                return false;
+            }
+        }
+
+        // Only drop the partition once the archive reads back completely.
+        SnapshotReader reader(archivePath);
+        size_t verified = 0;
+        uint8_t tableId;
+        while (reader.isOpen() && reader.nextRow(tableId)) {
+            std::string text;
+            uint32_t value;
+            for (const SnapshotColumn& column : messagesTable->columns) {
+                column.isText ? reader.readText(text) : reader.readInt(value);
+            }
+            ++verified;
+        }
+        if (reader.failed() || verified != exported) {
+            logger.Log<LogLevel::Error>("Archive verification failed.", logField("partition", partition), logField("shard", shard));
+            return false;
+        }
+
+        if (!dbManager.executeStatement("ALTER TABLE messages DROP PARTITION " + partition)) {
+            logger.Log<LogLevel::Error>("Failed to drop archived partition.", logField("partition", partition));
+            return false;
+        }
+        logger.Log<LogLevel::Info>("Partition archived.", logField("partition", partition), logField("shard", shard), logField("rows", exported));
+    }
+    return true;
+}
+
+bool RetentionManager::readArchived(const std::vector<SQLINTEGER>& senderIds, std::vector<ArchivedMessage>& messages) {
+    std::error_code error;
+    if (!isEnabled() || !std::filesystem::is_directory(archiveDirectory, error)) {
+        return true;
+    }
+
+    std::set<int> wanted(senderIds.begin(), senderIds.end());
+    auto appendWanted = [&](const SenderMessages& bySender) {
+        for (int senderId : wanted) {
+            auto found = bySender.find(senderId);
+            if (found != bySender.end()) {
+                messages.insert(messages.end(), found->second.begin(), found->second.end());
+            }
+        }
+    };
+
+    bool ok = true;
+    for (const auto& entry : std::filesystem::directory_iterator(archiveDirectory, error)) {
+        std::string path = entry.path().string();
+        if (entry.path().extension() != ".snap") {
+            continue;
+        }
+        std::filesystem::file_time_type modified = std::filesystem::last_write_time(entry.path(), error);
+
+        // Skip archives known not to hold any of these senders and serve
+        // cached ones from memory; a rewritten file is read again.
+        {
+            std::lock_guard<std::mutex> lock(archiveMutex);
+            auto known = archiveFiles.find(path);
+            if (known != archiveFiles.end() && known->second.modified == modified) {
+                bool relevant = false;
+                for (int senderId : wanted) {
+                    relevant = relevant || known->second.senders.count(senderId) > 0;
+                }
+                if (!relevant) {
+                    continue;
+                }
+                if (known->second.messages) {
+                    known->second.lastUsed = ++archiveUseCount;
+                    appendWanted(*known->second.messages);
+                    continue;
+                }
+            }
+        }
+
+        SnapshotReader reader(path);
+        std::shared_ptr<SenderMessages> bySender = std::make_shared<SenderMessages>();
+        size_t bytes = 0;
+        uint8_t tableId;
+        uint32_t messageId, senderId, receiverId, deliveryStatus;
+        std::string messageText, sendDate;
+        while (reader.isOpen() && reader.nextRow(tableId)) {
+            if (!reader.readInt(messageId) || !reader.readInt(senderId) || !reader.readInt(receiverId) ||
+                !reader.readText(messageText) || !reader.readText(sendDate) || !reader.readInt(deliveryStatus)) {
+                break;
+            }
+            (*bySender)[static_cast<int>(senderId)].push_back({ static_cast<int>(messageId), static_cast<int>(senderId),
+                static_cast<int>(receiverId), messageText, sendDate });
+            bytes += sizeof(ArchivedMessage) + messageText.size() + sendDate.size();
+        }
+        if (!reader.isOpen() || reader.failed()) {
+            logger.Log<LogLevel::Error>("Failed to read message archive.", logField("path", path));
+            ok = false;
+            continue;
+        }
+        appendWanted(*bySender);
+
+        std::lock_guard<std::mutex> lock(archiveMutex);
+        ArchiveFile& file = archiveFiles[path];
+        archiveCacheBytes -= file.messages ? file.bytes : 0;
+        file.modified = modified;
+        file.senders.clear();
+        for (const auto& sender : *bySender) {
+            file.senders.insert(sender.first);
+        }
+        file.messages.reset();
+        file.bytes = bytes;
+        file.lastUsed = ++archiveUseCount;
+        if (bytes > archiveCacheLimit) {
+            continue;
+        }
+        file.messages = bySender;
+        archiveCacheBytes += bytes;
+        while (archiveCacheBytes > archiveCacheLimit) {
+            auto oldest = archiveFiles.end();
+            for (auto it = archiveFiles.begin(); it != archiveFiles.end(); ++it) {
+                if (it->second.messages && it->first != path &&
+                    (oldest == archiveFiles.end() || it->second.lastUsed < oldest->second.lastUsed)) {
+                    oldest = it;
+                }
+            }
+            if (oldest == archiveFiles.end()) {
+                break;
+            }
+            archiveCacheBytes -= oldest->second.bytes;
+            oldest->second.messages.reset();
+        }
+    }
+    return ok;
+}
+
+bool RetentionManager::hasArchives() const {
+    std::error_code error;
+    if (!std::filesystem::is_directory(archiveDirectory, error)) {
+        return false;
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(archiveDirectory, error)) {
+        if (entry.path().extension() == ".snap") {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RetentionManager::purgeArchived(SQLINTEGER userId, size_t& deleted) {
+    std::lock_guard<std::mutex> writeLock(archiveWriteMutex);
+    std::error_code error;
+    if (!std::filesystem::is_directory(archiveDirectory, error)) {
+        return true;
+    }
+
+    const SnapshotTable* messagesTable = findSnapshotTable(3);
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(archiveDirectory, error)) {
+        if (entry.path().extension() == ".snap") {
+            paths.push_back(entry.path());
+        }
+    }
+
+    for (const std::filesystem::path& path : paths) {
+        struct Row {
+            uint32_t ints[4];
+            std::string messageText;
+            std::string sendDate;
+        };
+        std::vector<Row> kept;
+        size_t removed = 0;
+        SnapshotReader reader(path.string());
+        uint8_t tableId;
+        Row row;
+        while (reader.isOpen() && reader.nextRow(tableId)) {
+            if (!reader.readInt(row.ints[0]) || !reader.readInt(row.ints[1]) || !reader.readInt(row.ints[2]) ||
+                !reader.readText(row.messageText) || !reader.readText(row.sendDate) || !reader.readInt(row.ints[3])) {
+                break;
+            }
+            if (static_cast<SQLINTEGER>(row.ints[1]) == userId || static_cast<SQLINTEGER>(row.ints[2]) == userId) {
+                ++removed;
+            }
+            else {
+                kept.push_back(row);
+            }
+        }
+        if (!reader.isOpen() || reader.failed()) {
+            logger.Log<LogLevel::Error>("Failed to read message archive.", logField("path", path.string()));
+            return false;
+        }
+        if (removed == 0) {
+            continue;
+        }
+        if (kept.empty()) {
+            if (!std::filesystem::remove(path, error)) {
+                logger.Log<LogLevel::Error>("Failed to remove message archive.", logField("path", path.string()));
+                return false;
+            }
+            deleted += removed;
+            continue;
+        }
+
+        // Written next to the original and renamed over it, so a crash
+        // leaves either the old file or the complete new one.
+        std::filesystem::path rewritten = path;
+        rewritten += ".tmp";
+        {
+            SnapshotWriter writer(rewritten.string());
+            writer.beginTable(messagesTable->id);
+            for (const Row& message : kept) {
+                writer.writeInt(message.ints[0]);
+                writer.writeInt(message.ints[1]);
+                writer.writeInt(message.ints[2]);
+                writer.writeText(message.messageText.data(), message.messageText.size());
+                writer.writeText(message.sendDate.data(), message.sendDate.size());
+                writer.writeInt(message.ints[3]);
+                writer.endRow();
+            }
+            if (!writer.isOpen() || !writer.finish()) {
+                std::filesystem::remove(rewritten, error);
+                logger.Log<LogLevel::Error>("Failed to rewrite message archive.", logField("path", path.string()));
+                return false;
+            }
+        }
+        std::filesystem::rename(rewritten, path, error);
+        if (error) {
+            std::filesystem::remove(rewritten, error);
+            logger.Log<LogLevel::Error>("Failed to replace message archive.", logField("path", path.string()));
+            return false;
+        }
+        deleted += removed;
+    }
+    return true;
+}
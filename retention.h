@@ -0,0 +1,80 @@
+#pragma once
+#include "database.h"
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ArchivedMessage {
+    int messageId;
+    int senderId;
+    int receiverId;
+    std::string messageText;
+    std::string sendDate;
+};
+
+// Keeps the live messages table small. Each shard's messages table is
+// partitioned by month of send_date; a background archiver writes
+// partitions older than retention_days to compressed snapshot files in
+// archive_dir and drops them. History reads call readArchived() to reach
+// past the live window. Disabled unless retention_days is set in
+// chatdb.cfg.
+class RetentionManager {
+public:
+    static RetentionManager& instance();
+
+    bool isEnabled() const;
+    void start();
+    void stop();
+    bool runOnce();
+    bool readArchived(const std::vector<SQLINTEGER>& senderIds, std::vector<ArchivedMessage>& messages);
+    // True if archive_dir holds archived partitions, which live outside
+    // the database.
+    bool hasArchives() const;
+    // Rewrites every archive file holding messages sent or received by
+    // userId without them; deleted counts the rows removed.
+    bool purgeArchived(SQLINTEGER userId, size_t& deleted);
+
+private:
+    using SenderMessages = std::map<int, std::vector<ArchivedMessage>>;
+
+    // What is known about one archive file. senders is kept for every
+    // file read so far; the decoded rows are kept while they fit in
+    // archive_cache_mb, least recently used first out.
+    struct ArchiveFile {
+        std::filesystem::file_time_type modified;
+        std::set<int> senders;
+        std::shared_ptr<const SenderMessages> messages;
+        size_t bytes = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    RetentionManager();
+
+    bool preparePartitions(DatabaseManager& dbManager);
+    bool ensureFuturePartitions(DatabaseManager& dbManager);
+    bool archiveExpired(DatabaseManager& dbManager, size_t shard);
+
+    int retentionDays;
+    int intervalMinutes;
+    std::string archiveDirectory;
+
+    std::thread archiver;
+    std::mutex stateMutex;
+    std::condition_variable wakeUp;
+    std::atomic<bool> running;
+
+    // Held while archive files are written or rewritten.
+    std::mutex archiveWriteMutex;
+    std::mutex archiveMutex;
+    std::map<std::string, ArchiveFile> archiveFiles;
+    size_t archiveCacheLimit;
+    size_t archiveCacheBytes;
+    uint64_t archiveUseCount;
+};
@@ -0,0 +1,89 @@
+#include "router.h"
+#include "circuitbreaker.h"
+#include "config.h"
+#include "logger.h"
+
+std::wstring toWide(const std::string& value) {
+    return std::wstring(value.begin(), value.end());
+}
+
+DataSourceRouter& DataSourceRouter::instance() {
+    static DataSourceRouter router;
+    return router;
+}
+
+DataSourceRouter::DataSourceRouter() : nextReplica(0) {
+    std::vector<std::string> connectionStrings;
+    connectionStrings.push_back(config.get("primary", "DSN=chatdb;UID=root;PWD=root"));
+    for (const std::string& replica : config.getAll("replica")) {
+        connectionStrings.push_back(replica);
+    }
+
+    for (const std::string& connection : connectionStrings) {
+        std::unique_ptr<DataSource> source(new DataSource());
+        source->connectionString = toWide(connection);
+        source->activeConnections = 0;
+        sources.push_back(std::move(source));
+    }
+    pinDuration = std::chrono::milliseconds(config.getInt("read_your_writes_ms", 2000));
+
+    logger.Log<LogLevel::Info>("Data sources configured.", logField("count", sources.size()));
+}
+
+bool DataSourceRouter::isPinnedToPrimary(const std::string& session) {
+    if (session.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    auto it = pinnedSessions.find(session);
+    if (it == pinnedSessions.end()) {
+        return false;
+    }
+    if (std::chrono::steady_clock::now() >= it->second) {
+        pinnedSessions.erase(it);
+        return false;
+    }
+    return true;
+}
+
+size_t DataSourceRouter::acquire(AccessMode mode, const std::string& session) {
+    size_t chosen = primaryIndex;
+
+    if (mode == AccessMode::Read && sources.size() > 1 && !isPinnedToPrimary(session)) {
+        size_t replicaCount = sources.size() - 1;
+        size_t start = nextReplica++;
+        int bestLoad = 0;
+        for (size_t i = 0; i < replicaCount; ++i) {
+            size_t candidate = 1 + (start + i) % replicaCount;
+            if (!circuitBreakerFor(sources[candidate]->connectionString).isAvailable()) {
+                continue;
+            }
+            int load = sources[candidate]->activeConnections;
+            if (chosen == primaryIndex || load < bestLoad) {
+                chosen = candidate;
+                bestLoad = load;
+            }
+        }
+    }
+
+    ++sources[chosen]->activeConnections;
+    return chosen;
+}
+
+void DataSourceRouter::release(size_t sourceIndex) {
+    --sources[sourceIndex]->activeConnections;
+}
+
+void DataSourceRouter::recordWrite(const std::string& session) {
+    if (session.empty() || sources.size() == 1) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    pinnedSessions[session] = std::chrono::steady_clock::now() + pinDuration;
+}
+
+const std::wstring& DataSourceRouter::connectionString(size_t sourceIndex) const {
+    return sources[sourceIndex]->connectionString;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class AccessMode { Read, Write };
+
+// Sends writes to the primary and reads to the least loaded healthy
+// replica. A session that has just written is pinned to the primary for
+// read_your_writes_ms so it does not read stale data from a lagging
+// replica. Data sources come from chatdb.cfg:
+//   primary=DSN=chatdb;UID=root;PWD=root
+//   replica=DSN=chatdb_replica;UID=root;PWD=root
+class DataSourceRouter {
+public:
+    static const size_t primaryIndex = 0;
+    static const size_t noSource = static_cast<size_t>(-1);
+
+    static DataSourceRouter& instance();
+
+    size_t acquire(AccessMode mode, const std::string& session);
+    void release(size_t sourceIndex);
+    void recordWrite(const std::string& session);
+    const std::wstring& connectionString(size_t sourceIndex) const;
+
+private:
+    DataSourceRouter();
+
+    struct DataSource {
+        std::wstring connectionString;
+        std::atomic<int> activeConnections;
+    };
+
+    bool isPinnedToPrimary(const std::string& session);
+
+    std::vector<std::unique_ptr<DataSource>> sources;
+    std::atomic<size_t> nextReplica;
+    std::chrono::milliseconds pinDuration;
+    std::mutex sessionsMutex;
+    std::map<std::string, std::chrono::steady_clock::time_point> pinnedSessions;
+};
+
+std::wstring toWide(const std::string& value);
@@ -0,0 +1,293 @@
+#include "shards.h"
+#include "config.h"
+#include "inbox.h"
+#include "logger.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+static const char* queryCreateShardMessages = "CREATE TABLE IF NOT EXISTS messages ("
+    "message_id INTEGER PRIMARY KEY AUTO_INCREMENT,"
+    "sender_id INTEGER NOT NULL,"
+    "receiver_id INTEGER NOT NULL,"
+    "message_text TEXT NOT NULL,"
+    "send_date TIMESTAMP NOT NULL,"
+    "delivery_status INTEGER NOT NULL DEFAULT 0,"
+    "INDEX (sender_id, send_date),"
+    "INDEX (receiver_id)"
+    ");";
+
+static const char* queryCreateShardInbox = "CREATE TABLE IF NOT EXISTS inbox ("
+    "user_id INTEGER NOT NULL,"
+    "peer_id INTEGER NOT NULL,"
+    "last_message_id INTEGER NOT NULL,"
+    "preview VARCHAR(100) NOT NULL,"
+    "last_date TIMESTAMP NOT NULL,"
+    "unread_count INTEGER NOT NULL DEFAULT 0,"
+    "PRIMARY KEY (user_id, peer_id),"
+    "INDEX (user_id, last_date),"
+    "INDEX (peer_id)"
+    ");";
+
+static const char* queryCreatePlacements = "CREATE TABLE IF NOT EXISTS conversation_shards ("
+    "user_low INTEGER NOT NULL,"
+    "user_high INTEGER NOT NULL,"
+    "shard INTEGER NOT NULL,"
+    "PRIMARY KEY (user_low, user_high)"
+    ");";
+
+static bool executeOn(SQLHANDLE hdbc, const std::string& query) {
+    SQLHANDLE hstmt;
+    SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    SQLRETURN ret = SQLExecDirectA(hstmt, (SQLCHAR*)query.c_str(), SQL_NTS);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO || ret == SQL_NO_DATA;
+}
+
+MessageShards& MessageShards::instance() {
+    static MessageShards shards;
+    return shards;
+}
+
+MessageShards::MessageShards()
+    : placementsReady(false) {
+    std::string primary = config.get("primary", "DSN=chatdb;UID=root;PWD=root");
+    std::vector<std::string> shards = config.getAll("shard");
+    if (shards.empty()) {
+        shards.push_back(primary);
+    }
+    writableShards = shards.size();
+    if (std::find(shards.begin(), shards.end(), primary) == shards.end()) {
+        shards.push_back(primary);
+        logger.Log<LogLevel::Warn>("Primary is not listed as a shard; it is read but gets no new conversations.");
+    }
+
+    for (const std::string& shard : shards) {
+        connectionStrings.push_back(toWide(shard));
+        primaryShards.push_back(shard == primary);
+    }
+    tablesReady.reset(new std::atomic<bool>[shards.size()]);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        tablesReady[i] = primaryShards[i];
+    }
+
+    logger.Log<LogLevel::Info>("Message shards configured.", logField("count", shards.size()));
+}
+
+size_t MessageShards::count() const {
+    return connectionStrings.size();
+}
+
+size_t MessageShards::shardFor(SQLHANDLE primary, int userA, int userB) {
+    if (count() == 1) {
+        return 0;
+    }
+
+    SQLINTEGER low = std::min(userA, userB);
+    SQLINTEGER high = std::max(userA, userB);
+    {
+        std::lock_guard<std::mutex> lock(placementMutex);
+        auto cached = placements.find(std::make_pair(low, high));
+        if (cached != placements.end()) {
+            return cached->second;
+        }
+    }
+
+    uint64_t hash = (static_cast<uint64_t>(static_cast<uint32_t>(low)) << 32) | static_cast<uint32_t>(high);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    SQLINTEGER hashed = static_cast<SQLINTEGER>(hash % writableShards);
+
+    // INSERT IGNORE keeps whichever placement another session recorded
+    // first; it is read back either way.
+    SQLINTEGER shard = -1;
+    if (!ensurePlacements(primary) || !readPlacement(primary, low, high, shard) ||
+        (shard < 0 && (!executeOn(primary, "INSERT IGNORE INTO conversation_shards (user_low, user_high, shard) VALUES (" +
+            std::to_string(low) + ", " + std::to_string(high) + ", " + std::to_string(hashed) + ")") ||
+            !readPlacement(primary, low, high, shard))) ||
+        shard < 0 || static_cast<size_t>(shard) >= count()) {
+        std::cerr << "Failed to look up the shard of a conversation." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to look up conversation placement, using the hash.",
+            logField("low", low), logField("high", high), logField("shard", shard));
+        return static_cast<size_t>(hashed);
+    }
+    std::lock_guard<std::mutex> lock(placementMutex);
+    placements[std::make_pair(low, high)] = static_cast<size_t>(shard);
+    return static_cast<size_t>(shard);
+}
+
+bool MessageShards::readPlacement(SQLHANDLE primary, SQLINTEGER low, SQLINTEGER high, SQLINTEGER& shard) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryPlacement = "SELECT shard FROM conversation_shards WHERE user_low = ? AND user_high = ?";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, primary, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryPlacement.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &low, 0, NULL);
+    ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &high, 0, NULL);
+    ret = SQLExecute(hstmt);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+    ret = SQLBindCol(hstmt, 1, SQL_C_SLONG, &shard, sizeof(shard), NULL);
+    shard = -1;
+    ret = SQLFetch(hstmt);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO || ret == SQL_NO_DATA;
+}
+
+// An empty placement table means the placements were never recorded
+// (an older release, or the first run with shards), so they are rebuilt
+// from where each conversation's messages actually are. Sessions that
+// arrive during the rebuild wait for it.
+bool MessageShards::ensurePlacements(SQLHANDLE primary) {
+    if (placementsReady) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(placementsMutex);
+    if (placementsReady) {
+        return true;
+    }
+    if (!executeOn(primary, queryCreatePlacements)) {
+        return false;
+    }
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    SQLINTEGER recorded = 0;
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, primary, &hstmt);
+    ret = SQLExecDirectA(hstmt, (SQLCHAR*)"SELECT COUNT(*) FROM conversation_shards", SQL_NTS);
+    ret = SQLBindCol(hstmt, 1, SQL_C_SLONG, &recorded, sizeof(recorded), NULL);
+    ret = SQLFetch(hstmt);
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        return false;
+    }
+    if (recorded == 0 && !backfillPlacements(primary)) {
+        return false;
+    }
+    placementsReady = true;
+    return true;
+}
+
+bool MessageShards::backfillPlacements(SQLHANDLE primary) {
+    logger.Log<LogLevel::Info>("Recording conversation placements from existing messages.");
+    for (size_t shard = 0; shard < count(); ++shard) {
+        if (primaryShards[shard]) {
+            if (!executeOn(primary, "INSERT IGNORE INTO conversation_shards (user_low, user_high, shard) "
+                "SELECT DISTINCT LEAST(sender_id, receiver_id), GREATEST(sender_id, receiver_id), " + std::to_string(shard) +
+                " FROM messages")) {
+                return false;
+            }
+            continue;
+        }
+
+        DatabaseManager dbManager;
+        if (!connect(dbManager, shard)) {
+            return false;
+        }
+        SQLRETURN ret;
+        SQLHANDLE hstmt, hinsert;
+        SQLINTEGER low, high;
+        SQLINTEGER shardIndex = static_cast<SQLINTEGER>(shard);
+        ret = SQLAllocHandle(SQL_HANDLE_STMT, dbManager.getHDBC(), &hstmt);
+        ret = SQLExecDirectA(hstmt, (SQLCHAR*)"SELECT DISTINCT LEAST(sender_id, receiver_id), GREATEST(sender_id, receiver_id) FROM messages", SQL_NTS);
+        bool ok = ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO || ret == SQL_NO_DATA;
+        ret = SQLBindCol(hstmt, 1, SQL_C_SLONG, &low, sizeof(low), NULL);
+        ret = SQLBindCol(hstmt, 2, SQL_C_SLONG, &high, sizeof(high), NULL);
+
+        std::string queryInsert = "INSERT IGNORE INTO conversation_shards (user_low, user_high, shard) VALUES (?, ?, ?)";
+        ret = SQLAllocHandle(SQL_HANDLE_STMT, primary, &hinsert);
+        ret = SQLPrepareA(hinsert, (SQLCHAR*)queryInsert.c_str(), SQL_NTS);
+        ret = SQLBindParameter(hinsert, 1, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &low, 0, NULL);
+        ret = SQLBindParameter(hinsert, 2, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &high, 0, NULL);
+        ret = SQLBindParameter(hinsert, 3, SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &shardIndex, 0, NULL);
+        while (ok && SQLFetch(hstmt) == SQL_SUCCESS) {
+            ret = SQLExecute(hinsert);
+            ok = ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO;
+        }
+        SQLFreeHandle(SQL_HANDLE_STMT, hinsert);
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        dbManager.disconnectFromDatabase();
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MessageShards::isPrimary(size_t shard) const {
+    return primaryShards[shard];
+}
+
+bool MessageShards::connect(DatabaseManager& dbManager, size_t shard, AccessMode mode, const std::string& session) {
+    if (primaryShards[shard]) {
+        return dbManager.connectToDatabase(mode, session);
+    }
+    return dbManager.connectToDataSource(connectionStrings[shard]) && ensureTable(dbManager, shard);
+}
+
+bool MessageShards::ensureTable(DatabaseManager& dbManager, size_t shard) {
+    if (tablesReady[shard]) {
+        return true;
+    }
+    if (!dbManager.executeStatement(queryCreateShardMessages) || !dbManager.executeStatement(queryCreateShardInbox) ||
+        !InboxManager::rebuild(dbManager, true)) {
+        std::cerr << "Failed to create message tables on shard " << shard << "." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to create message tables on shard.");
+        return false;
+    }
+    tablesReady[shard] = true;
+    return true;
+}
+
+bool MessageShards::prepareInsert(DatabaseManager& dbManager, size_t shard) {
+    if (count() == 1) {
+        return true;
+    }
+    return dbManager.executeStatement("SET SESSION auto_increment_increment = " + std::to_string(count()) +
+        ", auto_increment_offset = " + std::to_string(shard + 1));
+}
+
+bool MessageShards::forEachShard(const std::function<bool(size_t shard, SQLHANDLE hdbc)>& fn,
+    AccessMode mode, const std::string& session, DatabaseManager* primaryConnection) {
+    auto runOnShard = [&](size_t shard) -> bool {
+        if (primaryShards[shard] && primaryConnection) {
+            return primaryConnection->connectToDatabase(mode, session) && fn(shard, primaryConnection->getHDBC());
+        }
+        DatabaseManager dbManager;
+        if (!connect(dbManager, shard, mode, session)) {
+            std::cerr << "Failed to connect to message shard " << shard << "." << std::endl;
+            logger.Log<LogLevel::Error>("Failed to connect to message shard.");
+            return false;
+        }
+        bool result = fn(shard, dbManager.getHDBC());
+        dbManager.disconnectFromDatabase();
+        return result;
+    };
+
+    if (count() == 1) {
+        return runOnShard(0);
+    }
+
+    std::unique_ptr<std::atomic<bool>[]> results(new std::atomic<bool>[count()]);
+    std::vector<std::thread> workers;
+    uint64_t traceId = currentTraceId();
+    for (size_t shard = 0; shard < count(); ++shard) {
+        workers.emplace_back([&, shard, traceId]() {
+            TraceContext context(traceId);
+            TraceSpan span("shards.worker");
+            results[shard] = runOnShard(shard);
+        });
+    }
+    bool ok = true;
+    for (size_t shard = 0; shard < count(); ++shard) {
+        workers[shard].join();
+        ok = ok && results[shard];
+    }
+    return ok;
+}
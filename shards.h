@@ -0,0 +1,64 @@
+#pragma once
+#include "database.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Places each conversation on one of N message backends so a single
+// conversation always lives on one shard. Shards are listed in
+// chatdb.cfg as "shard=" connection strings; without any, the primary
+// holds every message. Users and passwords always stay on the primary.
+//
+// A new conversation is placed by a hash of the (min, max) pair of the
+// participants' user ids and the choice is recorded in the primary's
+// conversation_shards table, so adding a shard later only affects new
+// conversations. Shards must therefore only ever be appended to the
+// list, never reordered or removed. If the list leaves out the primary
+// it is still read (it may hold older messages) but gets no new
+// conversations.
+class MessageShards {
+public:
+    static MessageShards& instance();
+
+    size_t count() const;
+    // primary is a connection to the primary, which holds the placements.
+    size_t shardFor(SQLHANDLE primary, int userA, int userB);
+    bool isPrimary(size_t shard) const;
+    bool connect(DatabaseManager& dbManager, size_t shard, AccessMode mode = AccessMode::Write, const std::string& session = "");
+    // Applies the per-shard auto_increment offset so message ids stay
+    // unique across shards.
+    bool prepareInsert(DatabaseManager& dbManager, size_t shard);
+
+    // Runs fn against every shard in parallel, one connection per shard.
+    // primaryConnection, if connected, is reused for the primary shard.
+    bool forEachShard(const std::function<bool(size_t shard, SQLHANDLE hdbc)>& fn,
+        AccessMode mode = AccessMode::Write, const std::string& session = "", DatabaseManager* primaryConnection = nullptr);
+
+private:
+    MessageShards();
+
+    bool ensureTable(DatabaseManager& dbManager, size_t shard);
+    bool ensurePlacements(SQLHANDLE primary);
+    bool backfillPlacements(SQLHANDLE primary);
+    bool readPlacement(SQLHANDLE primary, SQLINTEGER low, SQLINTEGER high, SQLINTEGER& shard);
+
+    std::vector<std::wstring> connectionStrings;
+    std::vector<bool> primaryShards;
+    // New conversations only go to the first writableShards shards; a
+    // primary missing from the configured list is appended after them.
+    size_t writableShards;
+    std::unique_ptr<std::atomic<bool>[]> tablesReady;
+
+    // placementMutex guards only the in-memory cache; lookups on the
+    // primary run without it. placementsMutex serialises the one-time
+    // setup of the placement table.
+    std::mutex placementMutex;
+    std::mutex placementsMutex;
+    std::atomic<bool> placementsReady;
+    std::map<std::pair<int, int>, size_t> placements;
+};
@@ -0,0 +1,1186 @@
+#include "snapshot.h"
+#include "config.h"
+#include "database.h"
+#include "inbox.h"
+#include "logger.h"
+#include "retention.h"
+#include "shards.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+static const char snapshotMagic[8] = { 'C', 'H', 'A', 'T', 'S', 'N', 'A', 'P' };
+static const uint32_t snapshotVersion = 1;
+static const uint8_t codecStored = 0;
+static const uint8_t codecLz = 1;
+
+static const SQLULEN fetchRows = 256;
+static const SQLINTEGER pageRows = 10000;
+static const size_t insertBatchRows = 1000;
+static const size_t rowsPerTransaction = 100000;
+
+const std::vector<SnapshotTable>& snapshotTables() {
+    static const std::vector<SnapshotTable> tables = {
+        { 1, "users", {
+            { "user_id", false, 0 },
+            { "first_name", true, 51 },
+            { "last_name", true, 51 },
+            { "email", true, 101 } }, 1, -1, -1, { 0 } },
+        { 2, "passwords", {
+            { "user_id", false, 0 },
+            { "password_hash", true, 33 } }, 1, -1, -1, { 0 } },
+        { 3, "messages", {
+            { "message_id", false, 0 },
+            { "sender_id", false, 0 },
+            { "receiver_id", false, 0 },
+            { "message_text", true, 0 },
+            { "send_date", true, 32 },
+            { "delivery_status", false, 0 } }, 1, 1, 2, { 1, 2 } },
+        { 4, "channels", {
+            { "channel_id", false, 0 },
+            { "name", true, 51 },
+            { "owner_id", false, 0 },
+            { "created_date", true, 32 } }, 1, -1, -1, {} },
+        { 5, "channel_members", {
+            { "channel_id", false, 0 },
+            { "user_id", false, 0 },
+            { "last_read_message_id", false, 0 } }, 2, -1, -1, { 1 } },
+        { 6, "channel_messages", {
+            { "message_id", false, 0 },
+            { "channel_id", false, 0 },
+            { "sender_id", false, 0 },
+            { "message_text", true, 0 },
+            { "send_date", true, 32 } }, 1, -1, -1, { 2 } },
+    };
+    return tables;
+}
+
+const SnapshotTable* findSnapshotTable(uint8_t tableId) {
+    for (const SnapshotTable& table : snapshotTables()) {
+        if (table.id == tableId) {
+            return &table;
+        }
+    }
+    return nullptr;
+}
+
+static std::array<uint32_t, 256> makeCrcTable() {
+    std::array<uint32_t, 256> table;
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+    // Function-local static: initialised once, thread-safe.
+    static const std::array<uint32_t, 256> table = makeCrcTable();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// LZ77 block codec in the spirit of LZ4: each sequence is a token
+// (literal length / match length nibbles), the literals, a 16-bit
+// back-reference offset and the extra match length. The last sequence
+// carries literals only.
+static void putLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+static void putSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - 4 : 0;
+    uint8_t token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+    token |= static_cast<uint8_t>(matchCode < 15 ? matchCode : 15);
+    out.push_back(token);
+    if (literalLength >= 15) {
+        putLength(out, literalLength - 15);
+    }
+    out.insert(out.end(), literals, literals + literalLength);
+    if (matchLength) {
+        out.push_back(static_cast<uint8_t>(offset & 0xFF));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (matchCode >= 15) {
+            putLength(out, matchCode - 15);
+        }
+    }
+}
+
+static void compressBlock(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+    const int hashBits = 14;
+    std::vector<uint32_t> positions(size_t(1) << hashBits, 0);
+    const size_t size = in.size();
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    out.clear();
+    while (pos + 4 <= size) {
+        uint32_t sequence;
+        std::memcpy(&sequence, &in[pos], 4);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+        size_t candidate = positions[hash];
+        positions[hash] = static_cast<uint32_t>(pos + 1);
+
+        if (candidate && pos - (candidate - 1) <= 0xFFFF && std::memcmp(&in[candidate - 1], &in[pos], 4) == 0) {
+            size_t matchStart = candidate - 1;
+            size_t matchLength = 4;
+            while (pos + matchLength < size && in[matchStart + matchLength] == in[pos + matchLength]) {
+                ++matchLength;
+            }
+            putSequence(out, &in[anchor], pos - anchor, pos - matchStart, matchLength);
+            pos += matchLength;
+            anchor = pos;
+        }
+        else {
+            ++pos;
+        }
+    }
+    putSequence(out, in.data() + anchor, size - anchor, 0, 0);
+}
+
+static bool readLength(const std::vector<uint8_t>& in, size_t& ip, size_t& length) {
+    uint8_t b;
+    do {
+        if (ip >= in.size()) {
+            return false;
+        }
+        b = in[ip++];
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+static bool decompressBlock(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, size_t rawLength) {
+    size_t ip = 0;
+    out.clear();
+    out.reserve(rawLength);
+
+    while (ip < in.size()) {
+        uint8_t token = in[ip++];
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(in, ip, literalLength)) {
+            return false;
+        }
+        if (ip + literalLength > in.size() || out.size() + literalLength > rawLength) {
+            return false;
+        }
+        out.insert(out.end(), in.begin() + ip, in.begin() + ip + literalLength);
+        ip += literalLength;
+        if (ip == in.size()) {
+            break;
+        }
+
+        if (ip + 2 > in.size()) {
+            return false;
+        }
+        size_t offset = in[ip] | (size_t(in[ip + 1]) << 8);
+        ip += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !readLength(in, ip, matchLength)) {
+            return false;
+        }
+        matchLength += 4;
+        if (offset == 0 || offset > out.size() || out.size() + matchLength > rawLength) {
+            return false;
+        }
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < matchLength; ++i) {
+            out.push_back(out[from + i]);
+        }
+    }
+    return out.size() == rawLength;
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void writeU32(std::ofstream& file, uint32_t value) {
+    uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+    file.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+static bool readU32(std::ifstream& file, uint32_t& value) {
+    uint8_t bytes[4];
+    if (!file.read(reinterpret_cast<char*>(bytes), 4)) {
+        return false;
+    }
+    value = bytes[0] | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+    return true;
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& filePath, uint32_t blockSize)
+    : file(filePath, std::ios::out | std::ios::binary | std::ios::trunc), blockSize(blockSize), currentTable(0), rowCount(0) {
+    if (file.is_open()) {
+        file.write(snapshotMagic, sizeof(snapshotMagic));
+        writeU32(file, snapshotVersion);
+        writeU32(file, blockSize);
+        block.reserve(blockSize + 8192);
+    }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (file.is_open()) {
+        file.close();
+    }
+}
+
+bool SnapshotWriter::isOpen() const {
+    return file.is_open();
+}
+
+void SnapshotWriter::beginTable(uint8_t tableId) {
+    flushBlock();
+    currentTable = tableId;
+}
+
+void SnapshotWriter::writeInt(uint32_t value) {
+    putVarint(block, value);
+}
+
+void SnapshotWriter::writeText(const char* data, size_t length) {
+    putVarint(block, static_cast<uint32_t>(length));
+    block.insert(block.end(), data, data + length);
+}
+
+void SnapshotWriter::endRow() {
+    ++rowCount;
+    if (block.size() >= blockSize) {
+        flushBlock();
+    }
+}
+
+void SnapshotWriter::flushBlock() {
+    if (rowCount == 0) {
+        return;
+    }
+
+    compressBlock(block, compressed);
+    bool useLz = compressed.size() < block.size();
+    const std::vector<uint8_t>& payload = useLz ? compressed : block;
+
+    file.put(static_cast<char>(currentTable));
+    file.put(static_cast<char>(useLz ? codecLz : codecStored));
+    writeU32(file, rowCount);
+    writeU32(file, static_cast<uint32_t>(block.size()));
+    writeU32(file, static_cast<uint32_t>(payload.size()));
+    writeU32(file, crc32(block.data(), block.size()));
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+
+    block.clear();
+    rowCount = 0;
+}
+
+bool SnapshotWriter::finish() {
+    flushBlock();
+    file.put(0);
+    file.put(static_cast<char>(codecStored));
+    for (int i = 0; i < 4; ++i) {
+        writeU32(file, 0);
+    }
+    file.flush();
+    return file.good();
+}
+
+SnapshotReader::SnapshotReader(const std::string& filePath)
+    : file(filePath, std::ios::in | std::ios::binary), valid(false), corrupt(false), currentTable(0), rowsLeft(0), position(0) {
+    char magic[sizeof(snapshotMagic)];
+    uint32_t version = 0;
+    uint32_t blockSize = 0;
+    if (file.read(magic, sizeof(magic)) && std::memcmp(magic, snapshotMagic, sizeof(magic)) == 0 &&
+        readU32(file, version) && version == snapshotVersion && readU32(file, blockSize)) {
+        valid = true;
+    }
+}
+
+bool SnapshotReader::isOpen() const {
+    return valid;
+}
+
+bool SnapshotReader::failed() const {
+    return corrupt;
+}
+
+bool SnapshotReader::loadBlock() {
+    int tableId = file.get();
+    int codec = file.get();
+    uint32_t rows, rawLength, storedLength, checksum;
+    if (tableId == EOF || codec == EOF || !readU32(file, rows) || !readU32(file, rawLength) ||
+        !readU32(file, storedLength) || !readU32(file, checksum)) {
+        corrupt = true;
+        return false;
+    }
+    if (tableId == 0) {
+        return false;
+    }
+
+    stored.resize(storedLength);
+    if (!file.read(reinterpret_cast<char*>(stored.data()), storedLength)) {
+        corrupt = true;
+        return false;
+    }
+    if (codec == codecLz) {
+        if (!decompressBlock(stored, block, rawLength)) {
+            corrupt = true;
+            return false;
+        }
+    }
+    else {
+        block.swap(stored);
+    }
+    if (block.size() != rawLength || crc32(block.data(), block.size()) != checksum) {
+        corrupt = true;
+        return false;
+    }
+
+    currentTable = static_cast<uint8_t>(tableId);
+    rowsLeft = rows;
+    position = 0;
+    return true;
+}
+
+bool SnapshotReader::nextRow(uint8_t& tableId) {
+    while (rowsLeft == 0) {
+        if (!valid || corrupt || !loadBlock()) {
+            return false;
+        }
+    }
+    --rowsLeft;
+    tableId = currentTable;
+    return true;
+}
+
+bool SnapshotReader::readInt(uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (position >= block.size()) {
+            corrupt = true;
+            return false;
+        }
+        uint8_t b = block[position++];
+        value |= uint32_t(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    corrupt = true;
+    return false;
+}
+
+bool SnapshotReader::readText(std::string& value) {
+    uint32_t length;
+    if (!readInt(length)) {
+        return false;
+    }
+    if (position + length > block.size()) {
+        corrupt = true;
+        return false;
+    }
+    value.assign(reinterpret_cast<const char*>(&block[position]), length);
+    position += length;
+    return true;
+}
+
+struct ColumnBuffer {
+    std::vector<SQLINTEGER> ints;
+    std::vector<char> text;
+    std::vector<SQLLEN> lengths;
+};
+
+static bool isLongColumn(const SnapshotColumn& column) {
+    return column.isText && column.width == 0;
+}
+
+// Unbounded columns are TEXT, so a value is at most 65535 bytes; binding
+// that much per row keeps block fetches for the messages table. The row
+// array is shrunk so one rowset stays within fetchBytes.
+static const SQLLEN longTextBytes = 65536;
+static const size_t fetchBytes = 8 * 1024 * 1024;
+
+static SQLLEN boundWidth(const SnapshotColumn& column) {
+    return isLongColumn(column) ? longTextBytes : column.width;
+}
+
+bool exportSnapshotTable(SQLHANDLE hdbc, const SnapshotTable& table, SnapshotWriter& writer, size_t& exported,
+    const std::string& partition, const std::set<int>& excludedUsers) {
+    std::string query = "SELECT ";
+    size_t rowBytes = 0;
+    for (size_t c = 0; c < table.columns.size(); ++c) {
+        query += (c ? ", " : "") + std::string(table.columns[c].name);
+        rowBytes += table.columns[c].isText ? static_cast<size_t>(boundWidth(table.columns[c])) : sizeof(SQLINTEGER);
+    }
+    std::string key, placeholders;
+    for (size_t c = 0; c < table.keyColumns; ++c) {
+        key += (c ? ", " : "") + std::string(table.columns[c].name);
+        placeholders += c ? ", ?" : "?";
+    }
+    query += std::string(" FROM ") + table.name;
+    if (!partition.empty()) {
+        query += " PARTITION (" + partition + ")";
+    }
+    if (table.keyColumns > 1) {
+        query += " WHERE (" + key + ") > (" + placeholders + ")";
+    }
+    else {
+        query += " WHERE " + key + " > ?";
+    }
+    query += " ORDER BY " + key + " LIMIT " + std::to_string(pageRows);
+
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)query.c_str(), SQL_NTS);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    SQLULEN rowArraySize = std::max<SQLULEN>(1, std::min<SQLULEN>(fetchRows, fetchBytes / rowBytes));
+    std::vector<SQLINTEGER> lastKey(table.keyColumns, 0);
+    SQLULEN rowsFetched = 0;
+    std::vector<SQLUSMALLINT> rowStatus(rowArraySize);
+    std::vector<ColumnBuffer> buffers(table.columns.size());
+
+    for (size_t c = 0; c < table.keyColumns; ++c) {
+        ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(c + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &lastKey[c], 0, NULL);
+    }
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)SQL_BIND_BY_COLUMN, 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)rowArraySize, 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROWS_FETCHED_PTR, &rowsFetched, 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_STATUS_PTR, rowStatus.data(), 0);
+
+    for (size_t c = 0; c < table.columns.size(); ++c) {
+        ColumnBuffer& buffer = buffers[c];
+        buffer.lengths.resize(rowArraySize);
+        if (table.columns[c].isText) {
+            SQLLEN width = boundWidth(table.columns[c]);
+            buffer.text.resize(rowArraySize * width);
+            SQLBindCol(hstmt, (SQLUSMALLINT)(c + 1), SQL_C_CHAR, buffer.text.data(), width, buffer.lengths.data());
+        }
+        else {
+            buffer.ints.resize(rowArraySize);
+            SQLBindCol(hstmt, (SQLUSMALLINT)(c + 1), SQL_C_SLONG, buffer.ints.data(), 0, buffer.lengths.data());
+        }
+    }
+
+    bool ok = true;
+    while (ok) {
+        ret = SQLExecute(hstmt);
+        if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+            ok = false;
+            break;
+        }
+
+        SQLINTEGER pageCount = 0;
+        while (ok && ((ret = SQLFetch(hstmt)) == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO)) {
+            for (SQLULEN r = 0; r < rowsFetched; ++r) {
+                if (rowStatus[r] != SQL_ROW_SUCCESS && rowStatus[r] != SQL_ROW_SUCCESS_WITH_INFO) {
+                    continue;
+                }
+                for (size_t c = 0; c < table.keyColumns; ++c) {
+                    lastKey[c] = buffers[c].ints[r];
+                }
+                ++pageCount;
+                bool excluded = false;
+                for (int c : table.userColumns) {
+                    excluded = excluded || excludedUsers.count(buffers[c].ints[r]) > 0;
+                }
+                if (excluded) {
+                    continue;
+                }
+                for (size_t c = 0; ok && c < table.columns.size(); ++c) {
+                    const ColumnBuffer& buffer = buffers[c];
+                    if (!table.columns[c].isText) {
+                        writer.writeInt(static_cast<uint32_t>(buffer.ints[r]));
+                        continue;
+                    }
+                    SQLLEN width = boundWidth(table.columns[c]);
+                    SQLLEN length = buffer.lengths[r] == SQL_NULL_DATA ? 0 : buffer.lengths[r];
+                    if (length == SQL_NO_TOTAL || length >= width) {
+                        std::cerr << "Value too long for snapshot in '" << table.name << "." << table.columns[c].name << "'." << std::endl;
+                        ok = false;
+                        break;
+                    }
+                    writer.writeText(&buffer.text[r * width], static_cast<size_t>(length));
+                }
+                if (!ok) {
+                    break;
+                }
+                writer.endRow();
+                ++exported;
+            }
+        }
+        SQLCloseCursor(hstmt);
+
+        if (pageCount < pageRows) {
+            break;
+        }
+    }
+
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return ok;
+}
+
+// Users tombstoned by --delete-user keep their rows until the purger
+// removes them; a snapshot leaves them out so an import does not bring
+// them back.
+static bool readDeletedUsers(SQLHANDLE hdbc, std::set<int>& userIds) {
+    SQLHANDLE hstmt;
+    SQLRETURN ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLExecDirectA(hstmt, (SQLCHAR*)"SELECT user_id FROM users WHERE deleted_at IS NOT NULL", SQL_NTS);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+    SQLINTEGER userId;
+    SQLBindCol(hstmt, 1, SQL_C_SLONG, &userId, 0, NULL);
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        userIds.insert(userId);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+bool SnapshotManager::exportSnapshot(const std::string& filePath) {
+    SnapshotWriter writer(filePath);
+    if (!writer.isOpen()) {
+        std::cerr << "Failed to open snapshot file for writing." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to open snapshot file for writing.");
+        return false;
+    }
+
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase()) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+
+    // Archived partitions are already snapshot files; they are not
+    // copied into the export.
+    if (RetentionManager::instance().hasArchives()) {
+        std::cout << "Warning: messages archived to '" << config.get("archive_dir", "archive")
+            << "' are not included; copy that directory along with the snapshot." << std::endl;
+        logger.Log<LogLevel::Warn>("Archived partitions are not included in the snapshot.");
+    }
+
+    dbManager.executeStatement("START TRANSACTION WITH CONSISTENT SNAPSHOT");
+    std::set<int> deletedUsers;
+    if (!readDeletedUsers(dbManager.getHDBC(), deletedUsers)) {
+        std::cerr << "Failed to read deleted users." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to read deleted users.");
+        dbManager.executeStatement("ROLLBACK");
+        dbManager.disconnectFromDatabase();
+        return false;
+    }
+
+    MessageShards& shards = MessageShards::instance();
+    for (const SnapshotTable& table : snapshotTables()) {
+        size_t exported = 0;
+        bool ok = true;
+        size_t shardCount = table.shardColumnA < 0 ? 1 : shards.count();
+        for (size_t shard = 0; ok && shard < shardCount; ++shard) {
+            writer.beginTable(table.id);
+            if (table.shardColumnA < 0 || shards.isPrimary(shard)) {
+                ok = exportSnapshotTable(dbManager.getHDBC(), table, writer, exported, "", deletedUsers);
+                continue;
+            }
+            DatabaseManager shardManager;
+            ok = shards.connect(shardManager, shard) &&
+                shardManager.executeStatement("START TRANSACTION WITH CONSISTENT SNAPSHOT") &&
+                exportSnapshotTable(shardManager.getHDBC(), table, writer, exported, "", deletedUsers);
+            shardManager.executeStatement("COMMIT");
+            shardManager.disconnectFromDatabase();
+        }
+        if (!ok) {
+            std::cerr << "Failed to export table '" << table.name << "'." << std::endl;
+            logger.Log<LogLevel::Error>("Failed to export snapshot table.");
+            dbManager.executeStatement("ROLLBACK");
+            dbManager.disconnectFromDatabase();
+            return false;
+        }
+        std::cout << "Exported " << exported << " rows from '" << table.name << "'." << std::endl;
+    }
+
+    dbManager.executeStatement("COMMIT");
+    dbManager.disconnectFromDatabase();
+
+    if (!writer.finish()) {
+        std::cerr << "Failed to write snapshot file." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to write snapshot file.");
+        return false;
+    }
+
+    std::cout << "Snapshot exported." << std::endl;
+    logger.Log<LogLevel::Info>("Snapshot exported.");
+    return true;
+}
+
+// Accumulates rows into column-wise parameter arrays and sends them with
+// a single SQLExecute per batch. Unbounded text columns are collected as
+// strings and bound at flush time with a buffer sized for the batch.
+class BatchInserter {
+public:
+    BatchInserter(SQLHANDLE hdbc, const SnapshotTable& table, const std::string& tableName)
+        : hdbc(hdbc), table(table), tableName(tableName), hstmt(NULL), rows(0), buffers(table.columns.size()), longValues(table.columns.size()) {}
+
+    ~BatchInserter() {
+        if (hstmt) {
+            SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        }
+    }
+
+    bool prepare() {
+        std::string query = "INSERT INTO " + tableName + " (";
+        std::string values;
+        for (size_t i = 0; i < table.columns.size(); ++i) {
+            query += (i ? ", " : "") + std::string(table.columns[i].name);
+            values += i ? ", ?" : "?";
+        }
+        query += ") VALUES (" + values + ")";
+
+        SQLRETURN ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+        ret = SQLPrepareA(hstmt, (SQLCHAR*)query.c_str(), SQL_NTS);
+        if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+            return false;
+        }
+
+        SQLSetStmtAttr(hstmt, SQL_ATTR_PARAM_BIND_TYPE, (SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN, 0);
+        for (size_t c = 0; c < table.columns.size(); ++c) {
+            ColumnBuffer& buffer = buffers[c];
+            const SnapshotColumn& column = table.columns[c];
+            buffer.lengths.resize(insertBatchRows);
+            if (isLongColumn(column)) {
+                longValues[c].resize(insertBatchRows);
+                continue;
+            }
+            if (column.isText) {
+                buffer.text.resize(insertBatchRows * column.width);
+                ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(c + 1), SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR,
+                    column.width - 1, 0, buffer.text.data(), column.width, buffer.lengths.data());
+            }
+            else {
+                buffer.ints.resize(insertBatchRows);
+                ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(c + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER,
+                    0, 0, buffer.ints.data(), 0, NULL);
+            }
+            if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void setInt(size_t column, uint32_t value) {
+        buffers[column].ints[rows] = static_cast<SQLINTEGER>(value);
+    }
+
+    bool setText(size_t column, const std::string& value) {
+        if (isLongColumn(table.columns[column])) {
+            longValues[column][rows] = value;
+            return true;
+        }
+        SQLLEN width = table.columns[column].width;
+        if (static_cast<SQLLEN>(value.size()) >= width) {
+            return false;
+        }
+        std::memcpy(&buffers[column].text[rows * width], value.data(), value.size());
+        buffers[column].lengths[rows] = static_cast<SQLLEN>(value.size());
+        return true;
+    }
+
+    bool endRow() {
+        ++rows;
+        return rows < insertBatchRows || flush();
+    }
+
+    bool flush() {
+        if (rows == 0) {
+            return true;
+        }
+        for (size_t c = 0; c < table.columns.size(); ++c) {
+            if (isLongColumn(table.columns[c]) && !bindLongColumn(c)) {
+                return false;
+            }
+        }
+        SQLSetStmtAttr(hstmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)rows, 0);
+        SQLRETURN ret = SQLExecute(hstmt);
+        rows = 0;
+        return (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO);
+    }
+
+private:
+    bool bindLongColumn(size_t column) {
+        SQLLEN width = 1;
+        for (size_t r = 0; r < rows; ++r) {
+            width = std::max(width, static_cast<SQLLEN>(longValues[column][r].size()) + 1);
+        }
+        ColumnBuffer& buffer = buffers[column];
+        buffer.text.assign(rows * width, 0);
+        for (size_t r = 0; r < rows; ++r) {
+            const std::string& value = longValues[column][r];
+            std::memcpy(&buffer.text[r * width], value.data(), value.size());
+            buffer.lengths[r] = static_cast<SQLLEN>(value.size());
+        }
+        SQLRETURN ret = SQLBindParameter(hstmt, (SQLUSMALLINT)(column + 1), SQL_PARAM_INPUT, SQL_C_CHAR, SQL_LONGVARCHAR,
+            width - 1, 0, buffer.text.data(), width, buffer.lengths.data());
+        return (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO);
+    }
+
+    SQLHANDLE hdbc;
+    const SnapshotTable& table;
+    std::string tableName;
+    SQLHANDLE hstmt;
+    size_t rows;
+    std::vector<ColumnBuffer> buffers;
+    std::vector<std::vector<std::string>> longValues;
+};
+
+static void commitAll(const std::vector<SQLHANDLE>& connections, SQLSMALLINT completion) {
+    for (SQLHANDLE hdbc : connections) {
+        SQLEndTran(SQL_HANDLE_DBC, hdbc, completion);
+    }
+}
+
+static const char* stagingSuffix = "_import";
+
+// Reads the whole file once, checking every block's CRC and that each
+// row decodes against its table, so a damaged snapshot is rejected
+// before the database is touched.
+static bool verifySnapshot(const std::string& filePath, size_t& rows) {
+    SnapshotReader reader(filePath);
+    if (!reader.isOpen()) {
+        return false;
+    }
+    uint8_t tableId;
+    uint32_t value;
+    std::string text;
+    rows = 0;
+    while (reader.nextRow(tableId)) {
+        const SnapshotTable* table = findSnapshotTable(tableId);
+        if (!table) {
+            return false;
+        }
+        for (const SnapshotColumn& column : table->columns) {
+            if (!(column.isText ? reader.readText(text) : reader.readInt(value))) {
+                return false;
+            }
+        }
+        ++rows;
+    }
+    return !reader.failed();
+}
+
+// shardConnections[i] is the connection for message shard i (the primary
+// connection for the primary shard); connections lists each one once.
+// Rows go into the staging tables (<table>_import).
+static bool importRows(SQLHANDLE hdbc, const std::vector<SQLHANDLE>& shardConnections,
+    const std::vector<SQLHANDLE>& connections, SnapshotReader& reader, size_t& imported) {
+    MessageShards& shards = MessageShards::instance();
+    const std::vector<SnapshotTable>& tables = snapshotTables();
+
+    // inserters[table][shard]; unsharded tables only use shard 0.
+    std::vector<std::vector<std::unique_ptr<BatchInserter>>> inserters(tables.size());
+    for (size_t t = 0; t < tables.size(); ++t) {
+        size_t shardCount = tables[t].shardColumnA < 0 ? 1 : shardConnections.size();
+        for (size_t shard = 0; shard < shardCount; ++shard) {
+            SQLHANDLE target = tables[t].shardColumnA < 0 ? hdbc : shardConnections[shard];
+            inserters[t].emplace_back(new BatchInserter(target, tables[t], tables[t].name + std::string(stagingSuffix)));
+            if (!inserters[t].back()->prepare()) {
+                std::cerr << "Failed to prepare insert into '" << tables[t].name << "'." << std::endl;
+                return false;
+            }
+        }
+    }
+
+    uint8_t tableId;
+    std::vector<uint32_t> ints;
+    std::vector<std::string> texts;
+    while (reader.nextRow(tableId)) {
+        const SnapshotTable* table = findSnapshotTable(tableId);
+        if (!table) {
+            std::cerr << "Unknown table in snapshot." << std::endl;
+            return false;
+        }
+
+        ints.resize(table->columns.size());
+        texts.resize(table->columns.size());
+        for (size_t c = 0; c < table->columns.size(); ++c) {
+            bool read = table->columns[c].isText ? reader.readText(texts[c]) : reader.readInt(ints[c]);
+            if (!read) {
+                return false;
+            }
+        }
+
+        size_t shard = 0;
+        if (table->shardColumnA >= 0) {
+            shard = shards.shardFor(hdbc, static_cast<int>(ints[table->shardColumnA]), static_cast<int>(ints[table->shardColumnB]));
+        }
+        BatchInserter& inserter = *inserters[table - tables.data()][shard];
+
+        for (size_t c = 0; c < table->columns.size(); ++c) {
+            if (!table->columns[c].isText) {
+                inserter.setInt(c, ints[c]);
+            }
+            else if (!inserter.setText(c, texts[c])) {
+                std::cerr << "Invalid value in snapshot for '" << table->name << "." << table->columns[c].name << "'." << std::endl;
+                return false;
+            }
+        }
+        if (!inserter.endRow()) {
+            std::cerr << "Failed to insert rows into '" << table->name << "'." << std::endl;
+            return false;
+        }
+
+        if (++imported % rowsPerTransaction == 0) {
+            commitAll(connections, SQL_COMMIT);
+            std::cout << "Imported " << imported << " rows..." << std::endl;
+        }
+    }
+
+    if (reader.failed()) {
+        std::cerr << "Snapshot file is corrupt." << std::endl;
+        return false;
+    }
+
+    for (auto& tableInserters : inserters) {
+        for (std::unique_ptr<BatchInserter>& inserter : tableInserters) {
+            if (!inserter->flush()) {
+                std::cerr << "Failed to insert rows." << std::endl;
+                return false;
+            }
+        }
+    }
+    commitAll(connections, SQL_COMMIT);
+    return true;
+}
+
+// One server taking part in an import: the tables staged on it and what
+// has to be restored once the load is done.
+struct StagingServer {
+    DatabaseManager* dbManager;
+    std::vector<const SnapshotTable*> tables;
+    bool primary;
+    std::vector<std::string> indexes;
+    std::vector<std::string> foreignKeys;
+    bool swapped;
+};
+
+// Secondary indexes of a staging table, as "ADD [UNIQUE] INDEX" clauses.
+static bool readSecondaryIndexes(SQLHANDLE hdbc, const std::string& tableName, std::vector<std::string>& indexes) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryIndexes = "SELECT INDEX_NAME, MIN(NON_UNIQUE), GROUP_CONCAT(CONCAT(COLUMN_NAME, "
+        "IF(SUB_PART IS NULL, '', CONCAT('(', SUB_PART, ')'))) ORDER BY SEQ_IN_INDEX) "
+        "FROM INFORMATION_SCHEMA.STATISTICS "
+        "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = ? AND INDEX_NAME <> 'PRIMARY' "
+        "GROUP BY INDEX_NAME";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryIndexes.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 64, 0, (SQLCHAR*)tableName.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+    SQLCHAR name[65], columns[512];
+    SQLINTEGER nonUnique;
+    SQLLEN nameLen, columnsLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_CHAR, name, sizeof(name), &nameLen);
+        SQLGetData(hstmt, 2, SQL_C_SLONG, &nonUnique, sizeof(nonUnique), NULL);
+        SQLGetData(hstmt, 3, SQL_C_CHAR, columns, sizeof(columns), &columnsLen);
+        indexes.push_back(std::string(nonUnique ? "ADD INDEX " : "ADD UNIQUE INDEX ") + (char*)name + " (" + (char*)columns + ")");
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+// Creates empty copies of the live tables and drops their secondary
+// indexes, which are built once after the load instead of row by row.
+static bool createStagingTables(StagingServer& server) {
+    DatabaseManager& dbManager = *server.dbManager;
+    for (const SnapshotTable* table : server.tables) {
+        std::string staging = table->name + std::string(stagingSuffix);
+        std::vector<std::string> indexes;
+        if (!dbManager.executeStatement("DROP TABLE IF EXISTS " + staging) ||
+            !dbManager.executeStatement("CREATE TABLE " + staging + " LIKE " + table->name) ||
+            !readSecondaryIndexes(dbManager.getHDBC(), staging, indexes)) {
+            return false;
+        }
+        if (indexes.empty()) {
+            continue;
+        }
+        std::string drops, adds;
+        for (size_t i = 0; i < indexes.size(); ++i) {
+            std::string name = indexes[i].substr(indexes[i].find("INDEX ") + 6);
+            drops += (i ? ", DROP INDEX " : "DROP INDEX ") + name.substr(0, name.find(' '));
+            adds += (i ? ", " : "") + indexes[i];
+        }
+        if (!dbManager.executeStatement("ALTER TABLE " + staging + " " + drops)) {
+            return false;
+        }
+        server.indexes.push_back("ALTER TABLE " + staging + " " + adds);
+    }
+    return true;
+}
+
+static bool restoreStagingIndexes(StagingServer& server) {
+    for (const std::string& statement : server.indexes) {
+        if (!server.dbManager->executeStatement(statement)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void dropStagingTables(StagingServer& server) {
+    for (const SnapshotTable* table : server.tables) {
+        server.dbManager->executeStatement("DROP TABLE IF EXISTS " + std::string(table->name) + stagingSuffix);
+    }
+}
+
+// CREATE TABLE ... LIKE copies neither foreign keys nor triggers, so the
+// live tables' foreign keys are read here and re-added after the swap.
+static bool readForeignKeys(SQLHANDLE hdbc, const std::string& tableName, std::vector<std::string>& statements) {
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryForeignKeys = "SELECT CONSTRAINT_NAME, GROUP_CONCAT(COLUMN_NAME ORDER BY ORDINAL_POSITION), "
+        "REFERENCED_TABLE_NAME, GROUP_CONCAT(REFERENCED_COLUMN_NAME ORDER BY ORDINAL_POSITION) "
+        "FROM INFORMATION_SCHEMA.KEY_COLUMN_USAGE "
+        "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = ? AND REFERENCED_TABLE_NAME IS NOT NULL "
+        "GROUP BY CONSTRAINT_NAME, REFERENCED_TABLE_NAME";
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryForeignKeys.c_str(), SQL_NTS);
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 64, 0, (SQLCHAR*)tableName.c_str(), 0, NULL);
+    ret = SQLExecute(hstmt);
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+    SQLCHAR name[65], columns[256], referenced[65], referencedColumns[256];
+    SQLLEN nameLen, columnsLen, referencedLen, referencedColumnsLen;
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        SQLGetData(hstmt, 1, SQL_C_CHAR, name, sizeof(name), &nameLen);
+        SQLGetData(hstmt, 2, SQL_C_CHAR, columns, sizeof(columns), &columnsLen);
+        SQLGetData(hstmt, 3, SQL_C_CHAR, referenced, sizeof(referenced), &referencedLen);
+        SQLGetData(hstmt, 4, SQL_C_CHAR, referencedColumns, sizeof(referencedColumns), &referencedColumnsLen);
+        statements.push_back("ALTER TABLE " + tableName + " ADD CONSTRAINT " + (char*)name + " FOREIGN KEY (" +
+            (char*)columns + ") REFERENCES " + (char*)referenced + "(" + (char*)referencedColumns + ")");
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+// Puts the staged tables in place on one server with a single atomic
+// RENAME TABLE. The live tables are kept as <table>_old, with their
+// foreign keys and triggers, until every server has swapped.
+static bool swapStagedTables(StagingServer& server) {
+    DatabaseManager& dbManager = *server.dbManager;
+    std::string renames, oldTables;
+    for (size_t i = 0; i < server.tables.size(); ++i) {
+        std::string name = server.tables[i]->name;
+        if (!readForeignKeys(dbManager.getHDBC(), name, server.foreignKeys)) {
+            return false;
+        }
+        renames += (i ? ", " : "") + name + " TO " + name + "_old, " + name + stagingSuffix + " TO " + name;
+        oldTables += (i ? ", " : "") + name + "_old";
+    }
+
+    if (!dbManager.executeStatement("SET FOREIGN_KEY_CHECKS = 0") ||
+        !dbManager.executeStatement("DROP TABLE IF EXISTS " + oldTables) ||
+        !dbManager.executeStatement("RENAME TABLE " + renames)) {
+        dbManager.executeStatement("SET FOREIGN_KEY_CHECKS = 1");
+        return false;
+    }
+    server.swapped = true;
+    return true;
+}
+
+// Puts the old tables back after another server failed to swap.
+static bool revertSwappedTables(StagingServer& server) {
+    std::string renames;
+    for (size_t i = 0; i < server.tables.size(); ++i) {
+        std::string name = server.tables[i]->name;
+        renames += (i ? ", " : "") + name + " TO " + name + stagingSuffix + ", " + name + "_old TO " + name;
+    }
+    bool ok = server.dbManager->executeStatement("RENAME TABLE " + renames);
+    server.dbManager->executeStatement("SET FOREIGN_KEY_CHECKS = 1");
+    server.swapped = !ok;
+    return ok;
+}
+
+// Once every server has swapped: drops the old copies, which frees their
+// constraint and trigger names, then restores foreign keys and, on the
+// primary, the users triggers.
+static bool finishSwap(StagingServer& server) {
+    DatabaseManager& dbManager = *server.dbManager;
+    std::string oldTables;
+    for (size_t i = 0; i < server.tables.size(); ++i) {
+        oldTables += (i ? ", " : "") + std::string(server.tables[i]->name) + "_old";
+    }
+    bool ok = dbManager.executeStatement("DROP TABLE " + oldTables);
+    for (const std::string& foreignKey : server.foreignKeys) {
+        ok = dbManager.executeStatement(foreignKey) && ok;
+    }
+    if (server.primary) {
+        ok = dbManager.createTriggers() && ok;
+    }
+    dbManager.executeStatement("SET FOREIGN_KEY_CHECKS = 1");
+    return ok;
+}
+
+bool SnapshotManager::importSnapshot(const std::string& filePath) {
+    size_t expectedRows = 0;
+    if (!verifySnapshot(filePath, expectedRows)) {
+        std::cerr << "Snapshot file is corrupt, truncated or in an unsupported format; nothing was changed." << std::endl;
+        logger.Log<LogLevel::Info>("Snapshot verification failed.");
+        return false;
+    }
+    SnapshotReader reader(filePath);
+
+    DatabaseManager dbManager;
+    if (!dbManager.connectToDatabase()) {
+        std::cerr << "Failed to connect to the database." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
+        return false;
+    }
+    SQLHANDLE hdbc = dbManager.getHDBC();
+
+    // stagingServers[0] is the primary, which holds every unsharded table
+    // and, when it is a shard, the sharded ones too; the others are the
+    // remaining shards.
+    MessageShards& shards = MessageShards::instance();
+    std::vector<std::unique_ptr<DatabaseManager>> shardManagers(shards.count());
+    std::vector<DatabaseManager*> servers(shards.count(), &dbManager);
+    std::vector<SQLHANDLE> shardConnections(shards.count(), hdbc);
+    std::vector<SQLHANDLE> connections(1, hdbc);
+    std::vector<const SnapshotTable*> primaryTables, shardTables;
+    for (const SnapshotTable& table : snapshotTables()) {
+        (table.shardColumnA < 0 ? primaryTables : shardTables).push_back(&table);
+    }
+    std::vector<StagingServer> stagingServers(1, StagingServer{ &dbManager, primaryTables, true, {}, {}, false });
+    bool ok = true;
+    for (size_t shard = 0; ok && shard < shards.count(); ++shard) {
+        if (shards.isPrimary(shard)) {
+            stagingServers[0].tables.insert(stagingServers[0].tables.end(), shardTables.begin(), shardTables.end());
+            continue;
+        }
+        shardManagers[shard].reset(new DatabaseManager());
+        ok = shards.connect(*shardManagers[shard], shard);
+        if (ok) {
+            servers[shard] = shardManagers[shard].get();
+            shardConnections[shard] = shardManagers[shard]->getHDBC();
+            connections.push_back(shardConnections[shard]);
+            stagingServers.push_back(StagingServer{ servers[shard], shardTables, false, {}, {}, false });
+        }
+    }
+
+    // The live tables are not touched until every row is in staging.
+    for (size_t i = 0; ok && i < stagingServers.size(); ++i) {
+        ok = createStagingTables(stagingServers[i]);
+    }
+
+    size_t imported = 0;
+    if (ok) {
+        for (StagingServer& server : stagingServers) {
+            server.dbManager->executeStatement("SET UNIQUE_CHECKS = 0");
+            SQLSetConnectAttr(server.dbManager->getHDBC(), SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_OFF, 0);
+        }
+        ok = importRows(hdbc, shardConnections, connections, reader, imported);
+        if (!ok) {
+            commitAll(connections, SQL_ROLLBACK);
+        }
+        for (StagingServer& server : stagingServers) {
+            SQLSetConnectAttr(server.dbManager->getHDBC(), SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_ON, 0);
+            server.dbManager->executeStatement("SET UNIQUE_CHECKS = 1");
+        }
+    }
+    ok = ok && imported == expectedRows;
+    for (size_t i = 0; ok && i < stagingServers.size(); ++i) {
+        ok = restoreStagingIndexes(stagingServers[i]);
+    }
+
+    // Either every server ends up on the imported tables or none does.
+    bool swapped = ok;
+    for (size_t i = 0; swapped && i < stagingServers.size(); ++i) {
+        swapped = swapStagedTables(stagingServers[i]);
+    }
+    bool reverted = true;
+    if (!swapped) {
+        for (StagingServer& server : stagingServers) {
+            if (server.swapped && !revertSwappedTables(server)) {
+                reverted = false;
+            }
+        }
+    }
+    bool finished = swapped;
+    for (size_t i = 0; swapped && i < stagingServers.size(); ++i) {
+        finished = finishSwap(stagingServers[i]) && finished;
+    }
+
+    // The inbox is derived from messages and is not in the snapshot, so
+    // every shard's copy is rebuilt from the imported messages.
+    bool rebuilt = swapped;
+    for (size_t shard = 0; rebuilt && shard < shards.count(); ++shard) {
+        rebuilt = InboxManager::rebuild(*servers[shard], false);
+    }
+    if (!swapped && reverted) {
+        for (StagingServer& server : stagingServers) {
+            dropStagingTables(server);
+        }
+    }
+
+    dbManager.disconnectFromDatabase();
+    for (std::unique_ptr<DatabaseManager>& shardManager : shardManagers) {
+        if (shardManager) {
+            shardManager->disconnectFromDatabase();
+        }
+    }
+
+    if (!ok) {
+        std::cerr << "Failed to import snapshot; the existing data was left in place." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to import snapshot.");
+        return false;
+    }
+    if (!reverted) {
+        std::cerr << "Failed to switch to the imported tables, and some servers could not be switched back. "
+            "Their previous tables are kept as <table>_old and the imported ones as <table>" << stagingSuffix << "." << std::endl;
+        logger.Log<LogLevel::Error>("Snapshot import left servers in a mixed state.");
+        return false;
+    }
+    if (!swapped) {
+        std::cerr << "Failed to switch to the imported tables; the existing data was left in place." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to switch to the imported tables.");
+        return false;
+    }
+    if (!finished) {
+        std::cerr << "Snapshot imported, but some foreign keys or triggers could not be restored." << std::endl;
+        logger.Log<LogLevel::Error>("Failed to restore foreign keys or triggers after import.");
+        return false;
+    }
+    if (!rebuilt) {
+        std::cerr << "Snapshot imported, but the inbox could not be rebuilt." << std::endl;
+        return false;
+    }
+
+    std::cout << "Snapshot imported: " << imported << " rows." << std::endl;
+    logger.Log<LogLevel::Info>("Snapshot imported.");
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <windows.h>
+#include <sqlext.h>
+#include <cstdint>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+// Snapshot file layout:
+//   header:  "CHATSNAP" | uint32 version | uint32 block size
+//   blocks:  uint8 table id | uint8 codec | uint32 row count | uint32 raw length
+//            | uint32 stored length | uint32 crc32 of raw data | stored data
+//   end:     a block with table id 0
+// Rows inside a block are a sequence of fields: integers as varints,
+// strings as a varint length followed by the bytes.
+
+// width is the bound buffer size for text columns, including the
+// terminator. Text columns with width 0 are unbounded (TEXT); they are
+// bound with a buffer for the largest TEXT value.
+struct SnapshotColumn {
+    const char* name;
+    bool isText;
+    SQLLEN width;
+};
+
+// Tables with shard columns are spread over the message shards by the
+// pair of user ids in those columns; the others live on the primary.
+// The first keyColumns columns are the primary key the export pages by;
+// userColumns hold user ids whose rows are left out of an export once
+// the user is deleted.
+struct SnapshotTable {
+    uint8_t id;
+    const char* name;
+    std::vector<SnapshotColumn> columns;
+    size_t keyColumns;
+    int shardColumnA;
+    int shardColumnB;
+    std::vector<int> userColumns;
+};
+
+const std::vector<SnapshotTable>& snapshotTables();
+const SnapshotTable* findSnapshotTable(uint8_t tableId);
+
+class SnapshotWriter {
+public:
+    SnapshotWriter(const std::string& filePath, uint32_t blockSize = 256 * 1024);
+    ~SnapshotWriter();
+
+    bool isOpen() const;
+    void beginTable(uint8_t tableId);
+    void writeInt(uint32_t value);
+    void writeText(const char* data, size_t length);
+    void endRow();
+    bool finish();
+
+private:
+    void flushBlock();
+
+    std::ofstream file;
+    uint32_t blockSize;
+    uint8_t currentTable;
+    uint32_t rowCount;
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> compressed;
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader(const std::string& filePath);
+
+    bool isOpen() const;
+    // Advances to the next row; returns false at the end of the snapshot
+    // or on a corrupt block (see failed()).
+    bool nextRow(uint8_t& tableId);
+    bool readInt(uint32_t& value);
+    bool readText(std::string& value);
+    bool failed() const;
+
+private:
+    bool loadBlock();
+
+    std::ifstream file;
+    bool valid;
+    bool corrupt;
+    uint8_t currentTable;
+    uint32_t rowsLeft;
+    size_t position;
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> stored;
+};
+
+// Streams one table (or one partition of it) into the writer, paging by
+// primary key and skipping rows of the excluded users.
+bool exportSnapshotTable(SQLHANDLE hdbc, const SnapshotTable& table, SnapshotWriter& writer, size_t& exported,
+    const std::string& partition = "", const std::set<int>& excludedUsers = std::set<int>());
+
+class SnapshotManager {
+public:
+    bool exportSnapshot(const std::string& filePath);
+    bool importSnapshot(const std::string& filePath);
+};
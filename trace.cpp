@@ -0,0 +1,115 @@
+#include "trace.h"
+#include <fstream>
+
+struct ThreadTraceBuffer {
+    std::mutex mutex;
+    uint32_t threadId;
+    std::vector<TraceEvent> events;
+};
+
+static thread_local uint64_t threadTraceId = 0;
+static thread_local std::shared_ptr<ThreadTraceBuffer> threadBuffer;
+
+static uint64_t swapTraceId(uint64_t traceId) {
+    uint64_t previous = threadTraceId;
+    threadTraceId = traceId;
+    return previous;
+}
+
+uint64_t currentTraceId() {
+    return threadTraceId;
+}
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() : enabled(false), nextTraceId(1), origin(std::chrono::steady_clock::now()), maxEvents(0) {
+}
+
+void Tracer::enable(const std::string& path, size_t maxEventsPerThread) {
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        outputPath = path;
+        maxEvents = maxEventsPerThread;
+    }
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::disable() {
+    enabled.store(false, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::newTraceId() {
+    return nextTraceId.fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t Tracer::nowUs() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+// Each thread appends to its own buffer; the buffer mutex is only
+// contended while flush() copies it out.
+void Tracer::record(const TraceEvent& event) {
+    if (!threadBuffer) {
+        threadBuffer = std::make_shared<ThreadTraceBuffer>();
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        threadBuffer->threadId = static_cast<uint32_t>(buffers.size() + 1);
+        buffers.push_back(threadBuffer);
+    }
+    std::lock_guard<std::mutex> lock(threadBuffer->mutex);
+    if (threadBuffer->events.size() < maxEvents) {
+        threadBuffer->events.push_back(event);
+    }
+}
+
+bool Tracer::flush() {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    if (outputPath.empty()) {
+        return true;
+    }
+    std::ofstream file(outputPath, std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    for (const std::shared_ptr<ThreadTraceBuffer>& buffer : buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        for (const TraceEvent& event : buffer->events) {
+            file << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"chat\",\"ph\":\"X\""
+                << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs
+                << ",\"pid\":1,\"tid\":" << buffer->threadId
+                << ",\"args\":{\"trace_id\":" << event.traceId << "}}";
+            first = false;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    return file.good();
+}
+
+TraceSpan::TraceSpan(const char* name) : name(name), startUs(0), active(Tracer::instance().isEnabled()) {
+    if (active) {
+        startUs = Tracer::instance().nowUs();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (active) {
+        Tracer& tracer = Tracer::instance();
+        tracer.record({ name, threadTraceId, startUs, tracer.nowUs() - startUs });
+    }
+}
+
+TraceAction::TraceAction(const char* name)
+    : context(Tracer::instance().isEnabled() ? Tracer::instance().newTraceId() : 0), span(name) {
+}
+
+TraceContext::TraceContext(uint64_t traceId) : previousTraceId(swapTraceId(traceId)) {
+}
+
+TraceContext::~TraceContext() {
+    swapTraceId(previousTraceId);
+}
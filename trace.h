@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Span tracing. Each user action gets a trace id (TraceAction); every
+// TraceSpan opened while it runs is recorded into a per-thread buffer
+// tagged with that id. Recording is off unless trace_file is set in
+// chatdb.cfg; flush() writes all buffers as Chrome trace-event JSON,
+// viewable in chrome://tracing or Perfetto.
+
+struct TraceEvent {
+    const char* name;
+    uint64_t traceId;
+    int64_t startUs;
+    int64_t durationUs;
+};
+
+struct ThreadTraceBuffer;
+
+class Tracer {
+public:
+    static Tracer& instance();
+
+    void enable(const std::string& outputPath, size_t maxEventsPerThread = 100000);
+    void disable();
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+    bool flush();
+
+    uint64_t newTraceId();
+    int64_t nowUs() const;
+    void record(const TraceEvent& event);
+
+private:
+    Tracer();
+
+    std::atomic<bool> enabled;
+    std::atomic<uint64_t> nextTraceId;
+    std::chrono::steady_clock::time_point origin;
+    size_t maxEvents;
+    std::string outputPath;
+    std::mutex buffersMutex;
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+};
+
+uint64_t currentTraceId();
+
+// Times the enclosing scope. name must outlive the tracer (a literal).
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    int64_t startUs;
+    bool active;
+};
+
+// Times a single call, e.g. ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+template <typename F>
+auto traced(const char* name, F&& fn) {
+    TraceSpan span(name);
+    return fn();
+}
+
+// Carries a trace id into a worker thread.
+class TraceContext {
+public:
+    explicit TraceContext(uint64_t traceId);
+    ~TraceContext();
+
+private:
+    uint64_t previousTraceId;
+};
+
+// Starts a new trace for one user action and times it as the root span.
+// The span is destroyed before the context, so it is recorded under the
+// action's own trace id.
+class TraceAction {
+public:
+    explicit TraceAction(const char* name);
+
+private:
+    TraceContext context;
+    TraceSpan span;
+};
@@ -1,6 +1,10 @@
 #include "users.h"
 #include "database.h" 
 #include "logger.h"
+#include "historycache.h"
+#include "purger.h"
+#include "trace.h"
+#include <string>
 
 extern SQLRETURN ret;
 extern SQLHANDLE henv;
@@ -19,10 +23,11 @@ UserManager::~UserManager() {
 }
 
 bool UserManager::registerUser(const std::string& first_name, const std::string& last_name, const std::string& email) {
+    TraceSpan span("users.registerUser");
     DatabaseManager dbManager;
-    if (!dbManager.connectToDatabase()) {
+    if (!dbManager.connectToDatabase(AccessMode::Write, first_name)) {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
         return false;
     }
 
@@ -33,28 +38,56 @@ bool UserManager::registerUser(const std::string& first_name, const std::string&
 
     ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
 
-    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryInsertUser.c_str(), SQL_NTS);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryInsertUser.c_str(), SQL_NTS); });
     ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
     ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)last_name.c_str(), 0, NULL);
     ret = SQLBindParameter(hstmt, 3, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 100, 0, (SQLCHAR*)email.c_str(), 0, NULL);
-    ret = SQLExecute(hstmt);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
 
     if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
         std::cerr << "Failed to register user." << std::endl;
-        logger.WriteLog("Failed to register user.");
+        logger.Log<LogLevel::Error>("Failed to register user.");
         return false;
     }
 
+    dbManager.recordWrite();
     std::cout << "User registered successfully." << std::endl;
-    logger.WriteLog("User registered successfully.");
+    logger.Log<LogLevel::Info>("User registered successfully.");
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
+}
+
+bool UserManager::findUserIds(SQLHANDLE hdbc, const std::string& first_name, std::vector<SQLINTEGER>& userIds) {
+    TraceSpan span("users.findUserIds");
+    SQLRETURN ret;
+    SQLHANDLE hstmt;
+    std::string queryGetUserIds = "SELECT user_id FROM users WHERE first_name = ? AND deleted_at IS NULL";
+
+    ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryGetUserIds.c_str(), SQL_NTS); });
+    ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+        SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+        return false;
+    }
+
+    SQLINTEGER userId;
+    SQLBindCol(hstmt, 1, SQL_C_SLONG, &userId, sizeof(userId), NULL);
+    while (SQLFetch(hstmt) == SQL_SUCCESS) {
+        userIds.push_back(userId);
+    }
+    SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    return true;
 }
 
 bool UserManager::deleteUserAndMessages(const std::string& first_name) {
+    TraceSpan span("users.deleteUserAndMessages");
     DatabaseManager dbManager;
 
-    if (!dbManager.connectToDatabase()) {
+    if (!dbManager.connectToDatabase(AccessMode::Write)) {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
         return false;
     }
 
@@ -62,42 +95,61 @@ bool UserManager::deleteUserAndMessages(const std::string& first_name) {
     SQLHANDLE hstmt;
     SQLHANDLE hdbc = dbManager.getHDBC();
 
-    std::string queryDeleteUserAndMessages = "DELETE FROM users WHERE first_name = ?";
+    // Only the tombstone is written here; UserPurger removes messages,
+    // channel data and finally the users row in small chunks, so a heavy
+    // user no longer locks the messages table in one big transaction.
+    // The email is renamed out of the way so it can be registered again
+    // while the tombstone waits for the purger.
+    std::string queryTombstoneUser = "UPDATE users SET deleted_at = NOW(), "
+        "email = LEFT(CONCAT('deleted-', user_id, '-', email), 100) "
+        "WHERE first_name = ? AND deleted_at IS NULL";
     ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
-    ret = SQLPrepareA(hstmt, (SQLCHAR*)queryDeleteUserAndMessages.c_str(), SQL_NTS);
+    ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryTombstoneUser.c_str(), SQL_NTS); });
     ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
 
-    ret = SQLExecute(hstmt);
+    ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
 
-    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO) {
+    if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO && ret != SQL_NO_DATA) {
         std::cerr << "Failed to delete user and messages." << std::endl;
-        logger.WriteLog("Failed to delete user and messages.");
+        logger.Log<LogLevel::Error>("Failed to delete user and messages.");
         SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
         return false;
     }
 
+    SQLLEN rows = 0;
+    SQLRowCount(hstmt, &rows);
     SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
+    if (rows <= 0) {
+        std::cerr << "User not found." << std::endl;
+        logger.Log<LogLevel::Warn>("User to delete not found.", logField("user", first_name));
+        return false;
+    }
+    HistoryCache::invalidate(first_name);
+    UserPurger::instance().wake();
+    logger.Log<LogLevel::Info>("User marked as deleted.", logField("user", first_name));
     return true;
 }
 
 
 bool UserManager::loginPass(const std::string& first_name, const std::string& password_hash) {
+    TraceSpan span("users.loginPass");
     DatabaseManager dbManager;
 
-    if (dbManager.connectToDatabase()) {
+    if (dbManager.connectToDatabase(AccessMode::Read, first_name)) {
+        SQLRETURN ret;
         SQLHANDLE hstmt;
         SQLHANDLE hdbc = dbManager.getHDBC();
 
         std::string queryLogin = "SELECT u.user_id FROM users u "
             "INNER JOIN passwords p ON u.user_id = p.user_id "
-            "WHERE u.first_name = ? AND p.password_hash = ?";
+            "WHERE u.first_name = ? AND p.password_hash = ? AND u.deleted_at IS NULL";
 
         ret = SQLAllocHandle(SQL_HANDLE_STMT, hdbc, &hstmt);
-        ret = SQLPrepareA(hstmt, (SQLCHAR*)queryLogin.c_str(), SQL_NTS);
+        ret = traced("sql.prepare", [&]() { return SQLPrepareA(hstmt, (SQLCHAR*)queryLogin.c_str(), SQL_NTS); });
         ret = SQLBindParameter(hstmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 50, 0, (SQLCHAR*)first_name.c_str(), 0, NULL);
         ret = SQLBindParameter(hstmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, 32, 0, (SQLCHAR*)password_hash.c_str(), 0, NULL);
 
-        ret = SQLExecute(hstmt);
+        ret = traced("sql.execute", [&]() { return SQLExecute(hstmt); });
 
         SQLINTEGER user_id = 0;
         ret = SQLBindCol(hstmt, 1, SQL_C_SLONG, &user_id, sizeof(user_id), NULL);
@@ -105,17 +157,17 @@ bool UserManager::loginPass(const std::string& first_name, const std::string& pa
         ret = SQLFetch(hstmt);
         if (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO) {
             std::cout << "Retrieved user_id: " << user_id << std::endl;
-            logger.WriteLog("Retrieved user_id: ");
+            logger.Log<LogLevel::Debug>("Retrieved user_id", logField("user_id", user_id));
             if (user_id > 0) {
                 std::cout << "Login successful. User ID: " << user_id << std::endl;
-                logger.WriteLog("Login successful. User ID: ");
+                logger.Log<LogLevel::Info>("Login successful.", logField("user_id", user_id));
                 SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
                 return true;
             }
         }
         else {
             std::cerr << "Login failed." << std::endl;
-            logger.WriteLog("Login failed.");
+            logger.Log<LogLevel::Warn>("Login failed.", logField("first_name", first_name));
             SQLFreeHandle(SQL_HANDLE_STMT, hstmt);
             return false;
         }
@@ -124,7 +176,7 @@ bool UserManager::loginPass(const std::string& first_name, const std::string& pa
     }
     else {
         std::cerr << "Failed to connect to the database." << std::endl;
-        logger.WriteLog("Failed to connect to the database.");
+        logger.Log<LogLevel::Error>("Failed to connect to the database.");
         return false;
     }
 
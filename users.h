@@ -13,6 +13,7 @@ public:
     bool registerUser(const std::string& first_name, const std::string& last_name, const std::string& email);
     bool deleteUserAndMessages(const std::string& first_name);
     bool loginPass(const std::string& first_name, const std::string& password_hash);
+    static bool findUserIds(SQLHANDLE hdbc, const std::string& first_name, std::vector<SQLINTEGER>& userIds);
 };
 
 